@@ -0,0 +1,207 @@
+// Copyright 2018 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Machine-readable benchmark results (JSON/CSV) and comparison against a
+// previous run, for tracking cycles per byte across compiler/kernel changes.
+
+#ifndef BENCHMARK_REPORT_H_
+#define BENCHMARK_REPORT_H_
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace randen {
+
+// One measurement, i.e. a line of RunBenchmark output.
+struct BenchmarkRecord {
+  std::string engine;
+  std::string benchmark;
+  size_t input;
+  double cpb;  // cycles per byte
+  double mad;  // median absolute deviation of cpb
+};
+
+// Describes where the records were obtained.
+struct BenchmarkContext {
+  std::string cpu;       // platform::BrandString()
+  std::string compiler;  // e.g. __VERSION__
+  std::string flags;     // compiler flags
+};
+
+namespace report {
+
+// Strings are written verbatim inside quotes; brand strings and flags do not
+// contain quotes or backslashes, so we replace them rather than escaping.
+static inline std::string Sanitize(const std::string& s) {
+  std::string ret = s;
+  for (char& c : ret) {
+    if (c == '"' || c == '\\' || c == '\n') c = ' ';
+  }
+  return ret;
+}
+
+// Returns the value of "key" in a line written by WriteJson, or an empty
+// string.
+static inline std::string JsonValue(const std::string& line,
+                                    const std::string& key) {
+  const std::string pattern = "\"" + key + "\": ";
+  const size_t pos = line.find(pattern);
+  if (pos == std::string::npos) return std::string();
+  size_t begin = pos + pattern.size();
+  if (line[begin] == '"') {
+    ++begin;
+    return line.substr(begin, line.find('"', begin) - begin);
+  }
+  return line.substr(begin, line.find_first_of(",}", begin) - begin);
+}
+
+// Splits a line written by WriteCsv into fields (which may be quoted).
+static inline std::vector<std::string> CsvFields(const std::string& line) {
+  std::vector<std::string> fields(1);
+  bool quoted = false;
+  for (const char c : line) {
+    if (c == '"') {
+      quoted = !quoted;
+    } else if (c == ',' && !quoted) {
+      fields.emplace_back();
+    } else if (c != '\r' && c != '\n') {
+      fields.back() += c;
+    }
+  }
+  return fields;
+}
+
+}  // namespace report
+
+// JSON: an object with the context and one result per line (which allows
+// ReadBenchmarkRecords to parse it without a full JSON parser).
+static inline bool WriteJson(const char* path, const BenchmarkContext& context,
+                             const std::vector<BenchmarkRecord>& records) {
+  FILE* f = fopen(path, "w");
+  if (f == nullptr) return false;
+  fprintf(f, "{\n\"cpu\": \"%s\",\n\"compiler\": \"%s\",\n\"flags\": \"%s\",\n",
+          report::Sanitize(context.cpu).c_str(),
+          report::Sanitize(context.compiler).c_str(),
+          report::Sanitize(context.flags).c_str());
+  fprintf(f, "\"results\": [\n");
+  for (size_t i = 0; i < records.size(); ++i) {
+    const BenchmarkRecord& r = records[i];
+    fprintf(f,
+            "{\"engine\": \"%s\", \"benchmark\": \"%s\", \"input\": %zu, "
+            "\"cpb\": %.4f, \"mad\": %.4f}%s\n",
+            r.engine.c_str(), r.benchmark.c_str(), r.input, r.cpb, r.mad,
+            i + 1 == records.size() ? "" : ",");
+  }
+  fprintf(f, "]\n}\n");
+  return fclose(f) == 0;
+}
+
+// CSV: header line, then one record per line including the context.
+static inline bool WriteCsv(const char* path, const BenchmarkContext& context,
+                            const std::vector<BenchmarkRecord>& records) {
+  FILE* f = fopen(path, "w");
+  if (f == nullptr) return false;
+  fprintf(f, "engine,benchmark,input,cpb,mad,cpu,compiler,flags\n");
+  for (const BenchmarkRecord& r : records) {
+    fprintf(f, "\"%s\",\"%s\",%zu,%.4f,%.4f,\"%s\",\"%s\",\"%s\"\n",
+            r.engine.c_str(), r.benchmark.c_str(), r.input, r.cpb, r.mad,
+            report::Sanitize(context.cpu).c_str(),
+            report::Sanitize(context.compiler).c_str(),
+            report::Sanitize(context.flags).c_str());
+  }
+  return fclose(f) == 0;
+}
+
+// Reads records from a file written by WriteJson or WriteCsv (detected from
+// the first character). Returns false if the file could not be opened.
+static inline bool ReadBenchmarkRecords(const char* path,
+                                        std::vector<BenchmarkRecord>* records) {
+  FILE* f = fopen(path, "r");
+  if (f == nullptr) return false;
+  std::vector<std::string> lines;
+  char buf[4096];
+  while (fgets(buf, sizeof(buf), f) != nullptr) {
+    lines.push_back(buf);
+  }
+  fclose(f);
+  if (lines.empty()) return true;
+
+  const bool is_json = lines[0][0] == '{';
+  for (size_t i = 1; i < lines.size(); ++i) {  // skip "{" or CSV header
+    BenchmarkRecord r;
+    if (is_json) {
+      r.engine = report::JsonValue(lines[i], "engine");
+      if (r.engine.empty()) continue;  // not a result line
+      r.benchmark = report::JsonValue(lines[i], "benchmark");
+      r.input = strtoul(report::JsonValue(lines[i], "input").c_str(), nullptr,
+                        10);
+      r.cpb = atof(report::JsonValue(lines[i], "cpb").c_str());
+      r.mad = atof(report::JsonValue(lines[i], "mad").c_str());
+    } else {
+      const std::vector<std::string> fields = report::CsvFields(lines[i]);
+      if (fields.size() < 5) continue;
+      r.engine = fields[0];
+      r.benchmark = fields[1];
+      r.input = strtoul(fields[2].c_str(), nullptr, 10);
+      r.cpb = atof(fields[3].c_str());
+      r.mad = atof(fields[4].c_str());
+    }
+    records->push_back(r);
+  }
+  return true;
+}
+
+// Prints the change in cpb of each record that is also in "baseline" and
+// returns the number of statistically significant regressions. A difference
+// is significant if it exceeds "num_sigma" standard deviations of the
+// difference, estimated from both MADs (sigma ~= 1.4826 * MAD for normal
+// distributions), and also "min_rel_change" to ignore negligible changes.
+static inline size_t CompareBenchmarkRecords(
+    const std::vector<BenchmarkRecord>& baseline,
+    const std::vector<BenchmarkRecord>& current, const double num_sigma = 3.0,
+    const double min_rel_change = 0.01) {
+  size_t num_regressions = 0;
+  printf("%8s %10s %7s: %6s -> %6s (%7s)\n", "Engine", "Benchmark", "Input",
+         "before", "after", "change");
+  for (const BenchmarkRecord& now : current) {
+    for (const BenchmarkRecord& before : baseline) {
+      if (before.engine != now.engine || before.benchmark != now.benchmark ||
+          before.input != now.input) {
+        continue;
+      }
+      const double diff = now.cpb - before.cpb;
+      const double sigma =
+          1.4826 * sqrt(before.mad * before.mad + now.mad * now.mad);
+      const bool significant = fabs(diff) > num_sigma * sigma &&
+                               fabs(diff) > min_rel_change * before.cpb;
+      const char* verdict = "";
+      if (significant) {
+        verdict = diff > 0.0 ? "REGRESSION" : "improvement";
+        num_regressions += diff > 0.0;
+      }
+      printf("%8s %10s %7zu: %6.2f -> %6.2f (%+6.1f%%) %s\n",
+             now.engine.c_str(), now.benchmark.c_str(), now.input, before.cpb,
+             now.cpb, diff / before.cpb * 100.0, verdict);
+    }
+  }
+  return num_regressions;
+}
+
+}  // namespace randen
+
+#endif  // BENCHMARK_REPORT_H_
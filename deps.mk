@@ -0,0 +1,46 @@
+obj/engine_test.o: engine_test.cc engine_aesctr.h engine_isaac.h \
+ engine_philox.h engine_rdrand.h util.h randen.h
+obj/nanobenchmark.o: nanobenchmark.cc nanobenchmark.h randen.h timer.h
+obj/nanobenchmark_test.o: nanobenchmark_test.cc nanobenchmark.h randen.h \
+ util.h vector128.h
+obj/randen.o: randen.cc randen.h randen_inl.h vector128.h
+obj/randen_arena.o: randen_arena.cc randen_arena.h randen.h
+obj/randen_arena_benchmark.o: randen_arena_benchmark.cc nanobenchmark.h \
+ randen_arena.h randen.h timer.h
+obj/randen_arena_test.o: randen_arena_test.cc randen_arena.h randen.h
+obj/randen_benchmark.o: randen_benchmark.cc randen.h benchmark_report.h \
+ engine_registry.h engine_isaac.h engine_os.h util.h engine_philox.h \
+ third_party/pcg_random/include/pcg_random.hpp \
+ third_party/pcg_random/include/pcg_extras.hpp engine_chacha.h \
+ engine_aesctr.h engine_rdrand.h randen_sim.h randen_inl.h vector128.h \
+ nanobenchmark.h timer.h
+obj/randen_components_benchmark.o: randen_components_benchmark.cc \
+ nanobenchmark.h randen.h timer.h
+obj/randen_hash.o: randen_hash.cc randen_hash.h randen.h randen_inl.h \
+ vector128.h
+obj/randen_hash_benchmark.o: randen_hash_benchmark.cc nanobenchmark.h \
+ randen_hash.h randen.h
+obj/randen_hash_test.o: randen_hash_test.cc randen_hash.h randen.h
+obj/randen_percpu.o: randen_percpu.cc randen_percpu.h randen.h \
+ randen_getrandom.h
+obj/randen_percpu_benchmark.o: randen_percpu_benchmark.cc randen.h \
+ randen_getrandom.h randen_percpu.h timer.h
+obj/randen_percpu_test.o: randen_percpu_test.cc randen_percpu.h
+obj/randen_preload.o: randen_preload.cc randen.h randen_getrandom.h
+obj/randen_preload_benchmark.o: randen_preload_benchmark.cc \
+ nanobenchmark.h
+obj/randen_preload_test.o: randen_preload_test.cc
+obj/randen_ring.o: randen_ring.cc randen_ring.h nanobenchmark.h randen.h \
+ randen_getrandom.h
+obj/randen_ring_benchmark.o: randen_ring_benchmark.cc nanobenchmark.h \
+ randen.h randen_ring.h timer.h
+obj/randen_ring_test.o: randen_ring_test.cc randen_ring.h
+obj/randen_stream.o: randen_stream.cc engine_registry.h engine_isaac.h \
+ engine_os.h util.h engine_philox.h \
+ third_party/pcg_random/include/pcg_random.hpp \
+ third_party/pcg_random/include/pcg_extras.hpp engine_chacha.h \
+ engine_aesctr.h engine_rdrand.h randen.h randen_sim.h randen_inl.h \
+ vector128.h
+obj/randen_test.o: randen_test.cc randen.h randen_sim.h randen_inl.h \
+ vector128.h
+obj/vector128_test.o: vector128_test.cc vector128.h
@@ -0,0 +1,144 @@
+// Copyright 2018 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ENGINE_AESCTR_H_
+#define ENGINE_AESCTR_H_
+#if defined(__SSE2__) && defined(__AES__)
+
+#include <stdint.h>
+#include <string.h>  // memcpy
+#include <limits>
+#include "tmmintrin.h"
+#include "wmmintrin.h"
+
+namespace randen {
+
+// AES-128 in counter mode (NIST SP 800-38A) via AESNI. The 128-bit counter
+// block is incremented as a big-endian integer, as in the standard. Generates
+// 16 blocks (256 bytes, same as Randen) per refill; the independent blocks
+// hide the AESENC latency.
+template <typename T>
+class alignas(32) AesCtr {
+ public:
+  // C++11 URBG interface:
+  using result_type = T;
+
+  static constexpr result_type min() {
+    return std::numeric_limits<result_type>::min();
+  }
+  static constexpr result_type max() {
+    return std::numeric_limits<result_type>::max();
+  }
+
+  // Key and initial counter are derived from "seedval".
+  explicit AesCtr(uint64_t seedval = 0) {
+    uint8_t key[16] = {0};
+    uint8_t counter[16] = {0};
+    memcpy(key, &seedval, sizeof(seedval));
+    seed(key, counter);
+  }
+
+  AesCtr(const uint8_t (&key)[16], const uint8_t (&counter)[16]) {
+    seed(key, counter);
+  }
+
+  void seed(const uint8_t (&key)[16], const uint8_t (&counter)[16]) {
+    ExpandKey(_mm_loadu_si128(reinterpret_cast<const __m128i*>(key)));
+    counter_ = _mm_loadu_si128(reinterpret_cast<const __m128i*>(counter));
+    next_ = kBufferT;  // The first call to operator() will trigger a refill.
+  }
+
+  result_type operator()() {
+    // (Local copy ensures compiler knows this is not aliased.)
+    size_t next = next_;
+
+    // Refill the buffer if needed (unlikely).
+    if (next >= kBufferT) {
+      Refill();
+      next = 0;
+    }
+
+    const result_type ret = buffer_[next];
+    next_ = next + 1;
+    return ret;
+  }
+
+ private:
+  static constexpr int kBlocks = 16;
+  static constexpr size_t kBufferT = kBlocks * 16 / sizeof(T);
+
+  template <int kRcon>
+  static __m128i ExpandStep(__m128i key) {
+    __m128i assist = _mm_aeskeygenassist_si128(key, kRcon);
+    assist = _mm_shuffle_epi32(assist, 0xFF);
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    return _mm_xor_si128(key, assist);
+  }
+
+  // FIPS-197 AES-128 key schedule.
+  void ExpandKey(const __m128i key) {
+    round_keys_[0] = key;
+    round_keys_[1] = ExpandStep<0x01>(round_keys_[0]);
+    round_keys_[2] = ExpandStep<0x02>(round_keys_[1]);
+    round_keys_[3] = ExpandStep<0x04>(round_keys_[2]);
+    round_keys_[4] = ExpandStep<0x08>(round_keys_[3]);
+    round_keys_[5] = ExpandStep<0x10>(round_keys_[4]);
+    round_keys_[6] = ExpandStep<0x20>(round_keys_[5]);
+    round_keys_[7] = ExpandStep<0x40>(round_keys_[6]);
+    round_keys_[8] = ExpandStep<0x80>(round_keys_[7]);
+    round_keys_[9] = ExpandStep<0x1B>(round_keys_[8]);
+    round_keys_[10] = ExpandStep<0x36>(round_keys_[9]);
+  }
+
+  // Returns the big-endian counter block plus one.
+  static __m128i Increment(const __m128i counter) {
+    const __m128i reverse =
+        _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    alignas(16) uint64_t lanes[2];  // little-endian after reversal
+    _mm_store_si128(reinterpret_cast<__m128i*>(lanes),
+                    _mm_shuffle_epi8(counter, reverse));
+    lanes[1] += (++lanes[0] == 0);
+    return _mm_shuffle_epi8(
+        _mm_load_si128(reinterpret_cast<const __m128i*>(lanes)), reverse);
+  }
+
+  void Refill() {
+    __m128i blocks[kBlocks];
+    for (int i = 0; i < kBlocks; ++i) {
+      blocks[i] = _mm_xor_si128(counter_, round_keys_[0]);
+      counter_ = Increment(counter_);
+    }
+    for (int round = 1; round < 10; ++round) {
+      for (int i = 0; i < kBlocks; ++i) {
+        blocks[i] = _mm_aesenc_si128(blocks[i], round_keys_[round]);
+      }
+    }
+    __m128i* to = reinterpret_cast<__m128i*>(buffer_);
+    for (int i = 0; i < kBlocks; ++i) {
+      _mm_store_si128(to + i, _mm_aesenclast_si128(blocks[i], round_keys_[10]));
+    }
+  }
+
+  alignas(32) result_type buffer_[kBufferT];
+  __m128i round_keys_[11];
+  __m128i counter_;  // next block, byte order as in memory
+  size_t next_;      // index within buffer_
+};
+
+}  // namespace randen
+
+#endif  // defined(__SSE2__) && defined(__AES__)
+#endif  // ENGINE_AESCTR_H_
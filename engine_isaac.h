@@ -0,0 +1,167 @@
+// Copyright 2018 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ENGINE_ISAAC_H_
+#define ENGINE_ISAAC_H_
+
+#include <stdint.h>
+#include <string.h>  // memcpy
+#include <limits>
+
+namespace randen {
+
+// ISAAC64 by Bob Jenkins (public domain reference: isaac64.c from
+// http://burtleburtle.net/bob/rand/isaacafa.html). Generates 256 64-bit values
+// per refill. Unlike the reference rand() macro, we return each batch in
+// forward order, which matches the reference test program (randvect64).
+template <typename T>
+class alignas(32) Isaac64 {
+ public:
+  // C++11 URBG interface:
+  using result_type = T;
+
+  static constexpr result_type min() {
+    return std::numeric_limits<result_type>::min();
+  }
+  static constexpr result_type max() {
+    return std::numeric_limits<result_type>::max();
+  }
+
+  explicit Isaac64(uint64_t seedval = 0) { seed(seedval); }
+
+  template <class SeedSequence>
+  explicit Isaac64(SeedSequence& seq) {
+    seed(seq);
+  }
+
+  void seed(uint64_t seedval) {
+    memset(results_, 0, sizeof(results_));
+    results_[0] = seedval;
+    Init();
+  }
+
+  template <class SeedSequence>
+  void seed(SeedSequence& seq) {
+    uint32_t words[2 * kSize];
+    seq.generate(words, words + 2 * kSize);
+    for (int i = 0; i < kSize; ++i) {
+      results_[i] = (static_cast<uint64_t>(words[2 * i + 1]) << 32) |
+                    words[2 * i + 0];
+    }
+    Init();
+  }
+
+  result_type operator()() {
+    // (Local copy ensures compiler knows this is not aliased.)
+    size_t next = next_;
+
+    // Refill the buffer if needed (unlikely).
+    if (next >= kResultsT) {
+      Generate();
+      next = 0;
+    }
+
+    result_type ret;
+    memcpy(&ret, reinterpret_cast<const uint8_t*>(results_) + next * sizeof(T),
+           sizeof(ret));
+    next_ = next + 1;
+    return ret;
+  }
+
+  // Reference randinit(TRUE) with the current results_ as the seed. The
+  // reference calls isaac64() once at the end, but its test program discards
+  // those values, so we mark them as consumed.
+  void Init() {
+    a_ = b_ = c_ = 0;
+    uint64_t x[8];
+    for (int j = 0; j < 8; ++j) {
+      x[j] = 0x9E3779B97F4A7C13ull;  // golden ratio
+    }
+    for (int i = 0; i < 4; ++i) {
+      Mix(x);
+    }
+
+    // Two passes: first over the seed, then over the first pass's output.
+    const uint64_t* sources[2] = {results_, memory_};
+    for (const uint64_t* source : sources) {
+      for (int i = 0; i < kSize; i += 8) {
+        for (int j = 0; j < 8; ++j) {
+          x[j] += source[i + j];
+        }
+        Mix(x);
+        memcpy(memory_ + i, x, sizeof(x));
+      }
+    }
+
+    Generate();
+    next_ = kResultsT;
+  }
+
+  // Reference isaac64(): refills results_.
+  void Generate() {
+    uint64_t a = a_;
+    uint64_t b = b_ + (++c_);
+    constexpr int kHalf = kSize / 2;
+    for (int i = 0; i < kSize; i += 4) {
+      const int i2 = (i + kHalf) % kSize;
+      Step(~(a ^ (a << 21)), i + 0, i2 + 0, &a, &b);
+      Step(a ^ (a >> 5), i + 1, i2 + 1, &a, &b);
+      Step(a ^ (a << 12), i + 2, i2 + 2, &a, &b);
+      Step(a ^ (a >> 33), i + 3, i2 + 3, &a, &b);
+    }
+    a_ = a;
+    b_ = b;
+  }
+
+ private:
+  static constexpr int kSizeLog2 = 8;
+  static constexpr int kSize = 1 << kSizeLog2;
+  static constexpr size_t kResultsT = kSize * sizeof(uint64_t) / sizeof(T);
+
+  // Returns memory_[(x / 8) % kSize] (x is a byte offset in the reference).
+  uint64_t Indirect(const uint64_t x) const {
+    return memory_[(x >> 3) & (kSize - 1)];
+  }
+
+  // "mix" is the new value of a before adding memory_[i2].
+  void Step(const uint64_t mix, const int i, const int i2, uint64_t* a,
+            uint64_t* b) {
+    const uint64_t x = memory_[i];
+    *a = mix + memory_[i2];
+    const uint64_t y = Indirect(x) + *a + *b;
+    memory_[i] = y;
+    *b = Indirect(y >> kSizeLog2) + x;
+    results_[i] = *b;
+  }
+
+  static void Mix(uint64_t* x) {
+    x[0] -= x[4]; x[5] ^= x[7] >> 9;  x[7] += x[0];
+    x[1] -= x[5]; x[6] ^= x[0] << 9;  x[0] += x[1];
+    x[2] -= x[6]; x[7] ^= x[1] >> 23; x[1] += x[2];
+    x[3] -= x[7]; x[0] ^= x[2] << 15; x[2] += x[3];
+    x[4] -= x[0]; x[1] ^= x[3] >> 14; x[3] += x[4];
+    x[5] -= x[1]; x[2] ^= x[4] << 20; x[4] += x[5];
+    x[6] -= x[2]; x[3] ^= x[5] >> 17; x[5] += x[6];
+    x[7] -= x[3]; x[4] ^= x[6] << 14; x[6] += x[7];
+  }
+
+  alignas(32) uint64_t results_[kSize];
+  uint64_t memory_[kSize];
+  uint64_t a_, b_, c_;
+  size_t next_;  // index within results_, in units of T
+};
+
+}  // namespace randen
+
+#endif  // ENGINE_ISAAC_H_
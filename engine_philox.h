@@ -0,0 +1,190 @@
+// Copyright 2018 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ENGINE_PHILOX_H_
+#define ENGINE_PHILOX_H_
+
+#include <stdint.h>
+#include <string.h>  // memcpy
+#include <limits>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace randen {
+
+// Counter-based Philox4x32-10 generator from "Parallel Random Numbers: As Easy
+// as 1, 2, 3" (Salmon et al., SC11). Each 128-bit counter is encrypted with a
+// 64-bit key via ten rounds of 32x32->64 bit multiplications. We compute four
+// consecutive counters at a time; with SSE2, each vector holds the same word
+// of all four blocks, so every instruction advances four counters.
+template <typename T>
+class alignas(32) Philox {
+ public:
+  // C++11 URBG interface:
+  using result_type = T;
+
+  static constexpr result_type min() {
+    return std::numeric_limits<result_type>::min();
+  }
+  static constexpr result_type max() {
+    return std::numeric_limits<result_type>::max();
+  }
+
+  explicit Philox(uint64_t seedval = 0, uint64_t stream = 0) {
+    seed(seedval, stream);
+  }
+
+  void seed(uint64_t seedval, uint64_t stream = 0) {
+    key_[0] = seedval & 0xFFFFFFFFu;
+    key_[1] = seedval >> 32;
+    stream_ = stream;
+    counter_ = 0;
+    next_ = kBufferT;  // The first call to operator() will trigger a refill.
+  }
+
+  result_type operator()() {
+    // (Local copy ensures compiler knows this is not aliased.)
+    size_t next = next_;
+
+    // Refill the buffer if needed (unlikely).
+    if (next >= kBufferT) {
+      const uint32_t counter[4] = {
+          static_cast<uint32_t>(counter_ & 0xFFFFFFFFu),
+          static_cast<uint32_t>(counter_ >> 32),
+          static_cast<uint32_t>(stream_ & 0xFFFFFFFFu),
+          static_cast<uint32_t>(stream_ >> 32)};
+      Blocks4(counter, key_, buffer_);
+      counter_ += 4;
+      next = 0;
+    }
+
+    result_type ret;
+    memcpy(&ret, buffer_ + next * sizeof(T) / sizeof(uint32_t), sizeof(ret));
+    next_ = next + 1;
+    return ret;
+  }
+
+  // Reference (one counter at a time) implementation: "out" = Philox4x32-10
+  // of the 128-bit "counter" (least-significant word first) and "key".
+  static void Block(const uint32_t counter[4], const uint32_t key[2],
+                    uint32_t out[4]) {
+    uint32_t x[4] = {counter[0], counter[1], counter[2], counter[3]};
+    uint32_t k[2] = {key[0], key[1]};
+    for (int round = 0; round < kRounds; ++round) {
+      const uint64_t product0 = static_cast<uint64_t>(kMul0) * x[0];
+      const uint64_t product1 = static_cast<uint64_t>(kMul1) * x[2];
+      const uint32_t hi0 = product0 >> 32;
+      const uint32_t hi1 = product1 >> 32;
+      x[0] = hi1 ^ x[1] ^ k[0];
+      x[1] = static_cast<uint32_t>(product1);
+      x[2] = hi0 ^ x[3] ^ k[1];
+      x[3] = static_cast<uint32_t>(product0);
+      k[0] += kWeyl0;
+      k[1] += kWeyl1;
+    }
+    memcpy(out, x, sizeof(x));
+  }
+
+  // Writes the blocks for "counter" + 0..3 (128-bit addition) to "out", in
+  // that order. Results are identical to four calls to Block.
+  static void Blocks4(const uint32_t counter[4], const uint32_t key[2],
+                      uint32_t out[16]) {
+    // Increment the 128-bit counter.
+    uint32_t counters[4][4];
+    memcpy(counters[0], counter, sizeof(counters[0]));
+    for (int i = 1; i < 4; ++i) {
+      memcpy(counters[i], counters[i - 1], sizeof(counters[i]));
+      for (int word = 0; word < 4 && ++counters[i][word] == 0; ++word) {
+      }
+    }
+
+#ifdef __SSE2__
+    // x[word] holds that word of all four blocks.
+    __m128i x[4];
+    for (int word = 0; word < 4; ++word) {
+      x[word] = _mm_set_epi32(counters[3][word], counters[2][word],
+                              counters[1][word], counters[0][word]);
+    }
+    __m128i k0 = _mm_set1_epi32(key[0]);
+    __m128i k1 = _mm_set1_epi32(key[1]);
+    const __m128i mul0 = _mm_set1_epi32(kMul0);
+    const __m128i mul1 = _mm_set1_epi32(kMul1);
+    const __m128i weyl0 = _mm_set1_epi32(kWeyl0);
+    const __m128i weyl1 = _mm_set1_epi32(kWeyl1);
+    for (int round = 0; round < kRounds; ++round) {
+      __m128i hi0, lo0, hi1, lo1;
+      MulHiLo(x[0], mul0, &hi0, &lo0);
+      MulHiLo(x[2], mul1, &hi1, &lo1);
+      x[0] = _mm_xor_si128(_mm_xor_si128(hi1, x[1]), k0);
+      x[1] = lo1;
+      x[2] = _mm_xor_si128(_mm_xor_si128(hi0, x[3]), k1);
+      x[3] = lo0;
+      k0 = _mm_add_epi32(k0, weyl0);
+      k1 = _mm_add_epi32(k1, weyl1);
+    }
+
+    // Transpose so that each block's words are contiguous.
+    const __m128i t0 = _mm_unpacklo_epi32(x[0], x[1]);
+    const __m128i t1 = _mm_unpacklo_epi32(x[2], x[3]);
+    const __m128i t2 = _mm_unpackhi_epi32(x[0], x[1]);
+    const __m128i t3 = _mm_unpackhi_epi32(x[2], x[3]);
+    __m128i* to = reinterpret_cast<__m128i*>(out);
+    _mm_storeu_si128(to + 0, _mm_unpacklo_epi64(t0, t1));
+    _mm_storeu_si128(to + 1, _mm_unpackhi_epi64(t0, t1));
+    _mm_storeu_si128(to + 2, _mm_unpacklo_epi64(t2, t3));
+    _mm_storeu_si128(to + 3, _mm_unpackhi_epi64(t2, t3));
+#else
+    for (int i = 0; i < 4; ++i) {
+      Block(counters[i], key, out + 4 * i);
+    }
+#endif
+  }
+
+ private:
+  static constexpr int kRounds = 10;
+  static constexpr uint32_t kMul0 = 0xD2511F53u;
+  static constexpr uint32_t kMul1 = 0xCD9E8D57u;
+  static constexpr uint32_t kWeyl0 = 0x9E3779B9u;  // golden ratio
+  static constexpr uint32_t kWeyl1 = 0xBB67AE85u;  // sqrt(3) - 1
+
+  // Four blocks of four 32-bit words.
+  static constexpr size_t kBufferT = 16 * sizeof(uint32_t) / sizeof(T);
+
+#ifdef __SSE2__
+  // Full 64-bit products of all four 32-bit lanes of "a" and "mul" (whose
+  // lanes must all be equal). PMULUDQ only multiplies the even lanes.
+  static inline void MulHiLo(const __m128i a, const __m128i mul, __m128i* hi,
+                             __m128i* lo) {
+    const __m128i product02 = _mm_mul_epu32(a, mul);
+    const __m128i product13 = _mm_mul_epu32(_mm_srli_epi64(a, 32), mul);
+    const __m128i mask_lo = _mm_set_epi32(0, -1, 0, -1);
+    *lo = _mm_or_si128(_mm_and_si128(product02, mask_lo),
+                       _mm_slli_epi64(product13, 32));
+    *hi = _mm_or_si128(_mm_srli_epi64(product02, 32),
+                       _mm_andnot_si128(mask_lo, product13));
+  }
+#endif
+
+  alignas(32) uint32_t buffer_[16];
+  uint32_t key_[2];
+  uint64_t stream_;
+  uint64_t counter_;  // of the next block to compute
+  size_t next_;       // index within buffer_, in units of T
+};
+
+}  // namespace randen
+
+#endif  // ENGINE_PHILOX_H_
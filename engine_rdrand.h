@@ -0,0 +1,196 @@
+// Copyright 2018 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ENGINE_RDRAND_H_
+#define ENGINE_RDRAND_H_
+#if defined(__x86_64__) || defined(_M_X64)
+
+#include <stdint.h>
+#include <string.h>  // memcpy
+
+#ifdef _MSC_VER
+#include <immintrin.h>
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#include <immintrin.h>  // _mm_pause
+#endif
+
+#include "util.h"
+
+namespace randen {
+
+// Hardware generators on x86: RDRAND returns the output of a CTR-DRBG that is
+// periodically reseeded by an on-chip entropy source; RDSEED returns
+// conditioned entropy and is intended for seeding other generators. Both may
+// transiently fail (carry flag clear) if the hardware is busy, so callers
+// must retry. Support must be detected via CPUID because the instructions
+// raise #UD on older CPUs and are sometimes masked by hypervisors.
+
+namespace rdrand {
+
+static inline void Cpuid(const uint32_t level, const uint32_t count,
+                         uint32_t* abcd) {
+#ifdef _MSC_VER
+  int regs[4];
+  __cpuidex(regs, level, count);
+  for (int i = 0; i < 4; ++i) {
+    abcd[i] = regs[i];
+  }
+#else
+  uint32_t a, b, c, d;
+  __cpuid_count(level, count, a, b, c, d);
+  abcd[0] = a;
+  abcd[1] = b;
+  abcd[2] = c;
+  abcd[3] = d;
+#endif
+}
+
+// Returns whether RDRAND is supported (CPUID.01H:ECX.RDRAND[bit 30]).
+static inline bool HaveRdrand() {
+  uint32_t abcd[4];
+  Cpuid(0, 0, abcd);
+  if (abcd[0] < 1) return false;
+  Cpuid(1, 0, abcd);
+  return (abcd[2] & (1u << 30)) != 0;
+}
+
+// Returns whether RDSEED is supported (CPUID.(EAX=07H,ECX=0H):EBX.RDSEED[18]).
+static inline bool HaveRdseed() {
+  uint32_t abcd[4];
+  Cpuid(0, 0, abcd);
+  if (abcd[0] < 7) return false;
+  Cpuid(7, 0, abcd);
+  return (abcd[1] & (1u << 18)) != 0;
+}
+
+// Single attempts; return false if no random value was available. We use
+// inline assembly (or MSVC intrinsics) so that callers need not compile with
+// -mrdrnd/-mrdseed; the caller is responsible for checking CPUID.
+static inline bool TryRdrand(uint64_t* value) {
+#ifdef _MSC_VER
+  unsigned long long v;
+  const int ok = _rdrand64_step(&v);
+  *value = v;
+  return ok != 0;
+#else
+  unsigned char ok;
+  asm volatile("rdrand %0\n\tsetc %1" : "=r"(*value), "=qm"(ok) : : "cc");
+  return ok != 0;
+#endif
+}
+
+static inline bool TryRdseed(uint64_t* value) {
+#ifdef _MSC_VER
+  unsigned long long v;
+  const int ok = _rdseed64_step(&v);
+  *value = v;
+  return ok != 0;
+#else
+  unsigned char ok;
+  asm volatile("rdseed %0\n\tsetc %1" : "=r"(*value), "=qm"(ok) : : "cc");
+  return ok != 0;
+#endif
+}
+
+// Intel's DRNG guide states that ten consecutive RDRAND failures indicate a
+// hardware problem, so we abort rather than return weak values.
+static inline uint64_t Rdrand() {
+  uint64_t value;
+  for (int retry = 0; retry < 10; ++retry) {
+    if (TryRdrand(&value)) return value;
+  }
+  RANDEN_CHECK(false);
+  return 0;
+}
+
+// RDSEED fails far more often when several cores request entropy, because
+// its throughput is limited by the entropy source. Back off via PAUSE.
+static inline uint64_t Rdseed() {
+  uint64_t value;
+  for (int retry = 0; retry < 100000; ++retry) {
+    if (TryRdseed(&value)) return value;
+    _mm_pause();
+  }
+  RANDEN_CHECK(false);
+  return 0;
+}
+
+}  // namespace rdrand
+
+// Buffered, uses RDRAND. Same 256-byte buffer as EngineOS.
+template <typename T>
+class alignas(32) EngineRdrand {
+ public:
+  // C++11 URBG interface:
+  using result_type = T;
+  static constexpr T min() { return T(0); }
+  static constexpr T max() { return ~T(0); }
+
+  // Callers must first check rdrand::HaveRdrand().
+  EngineRdrand() {
+    // The first call to operator() will trigger a refill.
+    next_ = kStateT;
+  }
+
+  // Returns random bits from the buffer in units of T.
+  T operator()() {
+    // (Local copy ensures compiler knows this is not aliased.)
+    size_t next = next_;
+
+    // Refill the buffer if needed (unlikely).
+    if (next >= kStateT) {
+      for (size_t i = 0; i < sizeof(state_) / sizeof(uint64_t); ++i) {
+        const uint64_t bits = rdrand::Rdrand();
+        memcpy(reinterpret_cast<uint8_t*>(state_) + i * sizeof(bits), &bits,
+               sizeof(bits));
+      }
+      next = 0;
+    }
+
+    const T ret = state_[next];
+    next_ = next + 1;
+    return ret;
+  }
+
+ private:
+  static constexpr size_t kStateT = 256 / sizeof(T);  // same as Randen
+
+  alignas(32) T state_[kStateT];
+  size_t next_;  // index within state_
+};
+
+// SeedSequence whose generate() draws from RDSEED, for reseeding engines
+// without a syscall, e.g. Randen::reseed (which calls Internal::Absorb).
+// Callers must first check rdrand::HaveRdseed().
+class RdseedSeedSeq {
+ public:
+  using result_type = uint32_t;
+
+  template <class RandomIt>
+  void generate(RandomIt begin, RandomIt end) {
+    while (begin != end) {
+      const uint64_t bits = rdrand::Rdseed();
+      *begin++ = static_cast<result_type>(bits);
+      if (begin == end) break;
+      *begin++ = static_cast<result_type>(bits >> 32);
+    }
+  }
+};
+
+}  // namespace randen
+
+#endif  // defined(__x86_64__) || defined(_M_X64)
+#endif  // ENGINE_RDRAND_H_
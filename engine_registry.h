@@ -0,0 +1,226 @@
+// Copyright 2018 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Engines compared by randen_benchmark (and available to randen_stream), and
+// selection by name.
+
+#ifndef ENGINE_REGISTRY_H_
+#define ENGINE_REGISTRY_H_
+
+// Engines that require special instructions are only available if enabled
+// here; all others are always compiled and selected via --engine.
+#if defined(__SSE2__) && defined(__AES__)
+#define ENABLE_CHACHA 1
+#define ENABLE_AESCTR 1
+#else
+#define ENABLE_CHACHA 0
+#define ENABLE_AESCTR 0
+#endif
+#if defined(__x86_64__) || defined(_M_X64)
+#define ENABLE_RDRAND 1  // also RDSEED; support is checked at runtime
+#else
+#define ENABLE_RDRAND 0
+#endif
+
+#include "engine_isaac.h"
+#include "engine_os.h"
+#include "engine_philox.h"
+#include "third_party/pcg_random/include/pcg_random.hpp"
+
+#if ENABLE_CHACHA
+#include "engine_chacha.h"
+#endif
+
+#if ENABLE_AESCTR
+#include "engine_aesctr.h"
+#endif
+
+#if ENABLE_RDRAND
+#include "engine_rdrand.h"
+#endif
+
+#include <ctype.h>
+#include <stdio.h>
+#include <random>  // mt19937_64
+#include <string>
+#include <vector>
+
+#include "randen.h"
+#include "randen_sim.h"
+
+namespace randen {
+
+#if ENABLE_RDRAND
+// Randen, reseeded from RDSEED (via Internal::Absorb, without a syscall) every
+// kReseedInterval outputs. Shows the cost of prediction resistance.
+template <typename T>
+class RandenRdseed {
+ public:
+  using result_type = T;
+  static constexpr T min() { return Randen<T>::min(); }
+  static constexpr T max() { return Randen<T>::max(); }
+
+  result_type operator()() {
+    if (--until_reseed_ == 0) {
+      RdseedSeedSeq seq;
+      randen_.reseed(seq);
+      until_reseed_ = kReseedInterval;
+    }
+    return randen_();
+  }
+
+ private:
+  static constexpr size_t kReseedInterval = 65536 / sizeof(T);
+
+  Randen<T> randen_;
+  size_t until_reseed_ = 1;  // reseed before the first output
+};
+#endif  // ENABLE_RDRAND
+
+// ChaCha with the (fixed) seed used for benchmarking; default-constructible
+// like the other engines, and also seedable via the constructor.
+#if ENABLE_CHACHA
+template <typename T>
+class ChaChaDefault : public ChaCha<T> {
+ public:
+  ChaChaDefault() : ChaCha<T>(0x243f6a8885a308d3ull, 0x243F6A8885A308D3ull) {}
+  explicit ChaChaDefault(uint64_t seedval) : ChaCha<T>(seedval) {}
+};
+#endif
+
+// Names of the engines or benchmarks to run, from a comma-separated list such
+// as --engine=randen,chacha. Matching ignores case and punctuation, and a
+// name without trailing digits also matches e.g. ChaCha8. Empty = all.
+class Selection {
+ public:
+  Selection() {}
+  explicit Selection(const char* list) {
+    std::string name;
+    for (const char* pos = list;; ++pos) {
+      if (*pos == ',' || *pos == '\0') {
+        if (!name.empty()) names_.push_back(Normalize(name.c_str()));
+        name.clear();
+        if (*pos == '\0') break;
+      } else {
+        name += *pos;
+      }
+    }
+  }
+
+  bool Contains(const char* caption) const {
+    if (names_.empty()) return true;
+    for (const std::string& name : names_) {
+      if (Matches(name, caption)) return true;
+    }
+    return false;
+  }
+
+  // Returns the first name that matches none of "captions", or nullptr.
+  const char* Unmatched(const std::vector<std::string>& captions) const {
+    for (const std::string& name : names_) {
+      bool found = false;
+      for (const std::string& caption : captions) {
+        found |= Matches(name, caption.c_str());
+      }
+      if (!found) return name.c_str();
+    }
+    return nullptr;
+  }
+
+ private:
+  static std::string Normalize(const char* caption) {
+    std::string ret;
+    for (const char* pos = caption; *pos != '\0'; ++pos) {
+      if (isalnum(*pos)) ret += static_cast<char>(tolower(*pos));
+    }
+    return ret;
+  }
+
+  static bool Matches(const std::string& name, const char* caption) {
+    const std::string normalized = Normalize(caption);
+    if (normalized.compare(0, name.size(), name) != 0) return false;
+    for (size_t i = name.size(); i < normalized.size(); ++i) {
+      if (!isdigit(normalized[i])) return false;
+    }
+    return true;
+  }
+
+  std::vector<std::string> names_;
+};
+
+// Base class of the visitors passed to ForeachEngine.
+class EngineVisitor {
+ public:
+  // Called instead of Visit if the CPU lacks the required instructions.
+  void Unsupported(const char* caption) {
+    printf("%8s: not supported by this CPU\n", caption);
+  }
+};
+
+template <class Engine, class Visitor>
+void VisitEngine(const Selection& engines, const char* caption,
+                 const bool supported, Visitor& visitor) {
+  if (!engines.Contains(caption)) return;
+  if (supported) {
+    visitor.template Visit<Engine>(caption);
+  } else {
+    visitor.Unsupported(caption);
+  }
+}
+
+// Engine registry: calls visitor.Visit<Engine>(caption) for each engine that
+// is compiled in and selected. Visitors default-construct their own engine(s),
+// e.g. one per thread.
+template <class Visitor>
+void ForeachEngine(const Selection& engines, Visitor& visitor) {
+  using T = uint64_t;  // WARNING: keep in sync with MT/PCG.
+
+  VisitEngine<Randen<T>>(engines, "Randen", true, visitor);
+
+  // Not cryptographic; for simulations (see randen_sim.h).
+  VisitEngine<RandenSim<T, 8>>(engines, "RandenSim8", true, visitor);
+  VisitEngine<RandenSim<T, 5>>(engines, "RandenSim5", true, visitor);
+
+  // Quoting from pcg_random.hpp: "the c variants offer better crypographic
+  // security (just how good the cryptographic security is is an open
+  // question)".
+  VisitEngine<pcg64_c32>(engines, "PCG", true, visitor);
+
+  VisitEngine<std::mt19937_64>(engines, "MT", true, visitor);
+
+#if ENABLE_CHACHA
+  VisitEngine<ChaChaDefault<T>>(engines, "ChaCha8", true, visitor);
+#endif
+
+#if ENABLE_AESCTR
+  VisitEngine<AesCtr<T>>(engines, "AES-CTR", true, visitor);
+#endif
+
+  VisitEngine<Philox<T>>(engines, "Philox", true, visitor);
+  VisitEngine<Isaac64<T>>(engines, "ISAAC", true, visitor);
+
+#if ENABLE_RDRAND
+  // Skip gracefully on CPUs (or VMs) without support.
+  VisitEngine<EngineRdrand<T>>(engines, "RDRAND", rdrand::HaveRdrand(),
+                               visitor);
+  VisitEngine<RandenRdseed<T>>(engines, "Randen+RDSEED", rdrand::HaveRdseed(),
+                               visitor);
+#endif
+
+  VisitEngine<EngineOS<T>>(engines, "OS", true, visitor);
+}
+
+}  // namespace randen
+
+#endif  // ENGINE_REGISTRY_H_
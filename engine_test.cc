@@ -0,0 +1,228 @@
+// Copyright 2018 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Verifies the engines compared in randen_benchmark against published
+// reference outputs ("known-answer tests"), and sanity-checks the hardware
+// generators if available.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>  // memcpy
+
+#include "engine_aesctr.h"
+#include "engine_isaac.h"
+#include "engine_philox.h"
+#include "engine_rdrand.h"
+#include "randen.h"
+
+namespace randen {
+namespace {
+
+#define STR(x) #x
+
+#define ASSERT_TRUE(condition)                                                \
+  do {                                                                        \
+    if (!(condition)) {                                                       \
+      printf("Assertion [" STR(condition) "] failed on line %d\n", __LINE__); \
+      abort();                                                                \
+    }                                                                         \
+  } while (false)
+
+// From kat_vectors in the Random123 distribution.
+void VerifyPhiloxKnownAnswers() {
+  const uint32_t counters[3][4] = {
+      {0x00000000, 0x00000000, 0x00000000, 0x00000000},
+      {0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF},
+      {0x243F6A88, 0x85A308D3, 0x13198A2E, 0x03707344}};
+  const uint32_t keys[3][2] = {{0x00000000, 0x00000000},
+                               {0xFFFFFFFF, 0xFFFFFFFF},
+                               {0xA4093822, 0x299F31D0}};
+  const uint32_t expected[3][4] = {
+      {0x6627E8D5, 0xE169C58D, 0xBC57AC4C, 0x9B00DBD8},
+      {0x408F276D, 0x41C83B0E, 0xA20BC7C6, 0x6D5451FD},
+      {0xD16CFE09, 0x94FDCCEB, 0x5001E420, 0x24126EA1}};
+
+  for (int i = 0; i < 3; ++i) {
+    uint32_t out[4];
+    Philox<uint32_t>::Block(counters[i], keys[i], out);
+    for (int word = 0; word < 4; ++word) {
+      ASSERT_TRUE(out[word] == expected[i][word]);
+    }
+
+    // The first of four blocks must also match.
+    uint32_t out4[16];
+    Philox<uint32_t>::Blocks4(counters[i], keys[i], out4);
+    for (int word = 0; word < 4; ++word) {
+      ASSERT_TRUE(out4[word] == expected[i][word]);
+    }
+  }
+}
+
+// Blocks4 (SIMD if available) must match the reference, including carries.
+void VerifyPhiloxBlocks4() {
+  const uint32_t key[2] = {0x13198A2E, 0x03707344};
+  const uint32_t counter[4] = {0xFFFFFFFE, 0xFFFFFFFF, 0x00000007, 0};
+  uint32_t out4[16];
+  Philox<uint32_t>::Blocks4(counter, key, out4);
+
+  uint32_t expected_counter[4] = {counter[0], counter[1], counter[2], 0};
+  for (int i = 0; i < 4; ++i) {
+    uint32_t out[4];
+    Philox<uint32_t>::Block(expected_counter, key, out);
+    for (int word = 0; word < 4; ++word) {
+      ASSERT_TRUE(out4[4 * i + word] == out[word]);
+    }
+    for (int word = 0; word < 4 && ++expected_counter[word] == 0; ++word) {
+    }
+  }
+}
+
+// The engine returns consecutive blocks of a zero-based counter.
+void VerifyPhiloxEngine() {
+  const uint64_t seed = 0x299F31D0A4093822ull;
+  Philox<uint32_t> engine32(seed);
+  Philox<uint64_t> engine64(seed);
+
+  const uint32_t key[2] = {0xA4093822, 0x299F31D0};
+  for (uint32_t block = 0; block < 9; ++block) {
+    const uint32_t counter[4] = {block, 0, 0, 0};
+    uint32_t out[4];
+    Philox<uint32_t>::Block(counter, key, out);
+    for (int word = 0; word < 4; ++word) {
+      ASSERT_TRUE(engine32() == out[word]);
+    }
+    for (int word = 0; word < 4; word += 2) {
+      const uint64_t expected = (uint64_t(out[word + 1]) << 32) | out[word];
+      ASSERT_TRUE(engine64() == expected);
+    }
+  }
+}
+
+// First values of randvect64.txt, generated by the reference isaac64.c with
+// an all-zero seed.
+void VerifyIsaac64KnownAnswers() {
+  const uint64_t expected[8] = {
+      0x12A8F216AF9418C2ull, 0xD4490AD526F14431ull, 0xB49C3B3995091A36ull,
+      0x5B45E522E4B1B4EFull, 0xA1E9300CD8520548ull, 0x49787FEF17AF9924ull,
+      0x03219A39EE587A30ull, 0xEBE9EA2ADF4321C7ull};
+  Isaac64<uint64_t> engine64;
+  Isaac64<uint32_t> engine32;
+  for (const uint64_t value : expected) {
+    ASSERT_TRUE(engine64() == value);
+    ASSERT_TRUE(engine32() == static_cast<uint32_t>(value));
+    ASSERT_TRUE(engine32() == static_cast<uint32_t>(value >> 32));
+  }
+
+  // Crossing into the next batch must not repeat values.
+  Isaac64<uint64_t> engine;
+  uint64_t first[256];
+  for (uint64_t& value : first) {
+    value = engine();
+  }
+  ASSERT_TRUE(engine() != first[0]);
+}
+
+#if defined(__SSE2__) && defined(__AES__)
+
+// NIST SP 800-38A F.5.1 (CTR-AES128.Encrypt): the keystream is the XOR of
+// plaintext and ciphertext. The second counter block crosses a byte carry.
+void VerifyAesCtrKnownAnswers() {
+  const uint8_t key[16] = {0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+                           0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c};
+  const uint8_t counter[16] = {0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7,
+                               0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff};
+  const uint8_t plaintext[2][16] = {
+      {0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11,
+       0x73, 0x93, 0x17, 0x2a},
+      {0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c, 0x9e, 0xb7, 0x6f, 0xac,
+       0x45, 0xaf, 0x8e, 0x51}};
+  const uint8_t ciphertext[2][16] = {
+      {0x87, 0x4d, 0x61, 0x91, 0xb6, 0x20, 0xe3, 0x26, 0x1b, 0xef, 0x68, 0x64,
+       0x99, 0x0d, 0xb6, 0xce},
+      {0x98, 0x06, 0xf6, 0x6b, 0x79, 0x70, 0xfd, 0xff, 0x86, 0x17, 0x18, 0x7b,
+       0xb9, 0xff, 0xfd, 0xff}};
+
+  AesCtr<uint64_t> engine(key, counter);
+  for (int block = 0; block < 2; ++block) {
+    uint8_t keystream[16];
+    for (int i = 0; i < 2; ++i) {
+      const uint64_t bits = engine();
+      memcpy(keystream + i * sizeof(bits), &bits, sizeof(bits));
+    }
+    for (int i = 0; i < 16; ++i) {
+      ASSERT_TRUE(keystream[i] == (plaintext[block][i] ^ ciphertext[block][i]));
+    }
+  }
+}
+
+#endif  // defined(__SSE2__) && defined(__AES__)
+
+#if defined(__x86_64__) || defined(_M_X64)
+
+// Skipped if unsupported. Also catches CPUs whose RDRAND returns constants
+// (e.g. all-ones after some AMD firmware bugs).
+void VerifyRdrand() {
+  if (!rdrand::HaveRdrand()) {
+    printf("RDRAND not supported, skipping\n");
+    return;
+  }
+  EngineRdrand<uint64_t> engine;
+  const uint64_t first = engine();
+  bool any_different = false;
+  for (int i = 0; i < 64; ++i) {
+    any_different |= engine() != first;
+  }
+  ASSERT_TRUE(any_different);
+}
+
+void VerifyRdseedReseed() {
+  if (!rdrand::HaveRdseed()) {
+    printf("RDSEED not supported, skipping\n");
+    return;
+  }
+  Randen<uint64_t> engine1;
+  Randen<uint64_t> engine2;
+  RdseedSeedSeq seq;
+  engine2.reseed(seq);
+  for (int i = 0; i < 64; ++i) {
+    ASSERT_TRUE(engine1() != engine2());
+  }
+}
+
+#endif  // defined(__x86_64__) || defined(_M_X64)
+
+void RunAll() {
+  // Immediately output any results (for non-local runs).
+  setvbuf(stdout, nullptr, _IONBF, 0);
+
+  VerifyPhiloxKnownAnswers();
+  VerifyPhiloxBlocks4();
+  VerifyPhiloxEngine();
+  VerifyIsaac64KnownAnswers();
+#if defined(__SSE2__) && defined(__AES__)
+  VerifyAesCtrKnownAnswers();
+#endif
+#if defined(__x86_64__) || defined(_M_X64)
+  VerifyRdrand();
+  VerifyRdseedReseed();
+#endif
+}
+
+}  // namespace
+}  // namespace randen
+
+int main(int argc, char* argv[]) {
+  randen::RunAll();
+  return 0;
+}
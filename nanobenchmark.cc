@@ -14,6 +14,7 @@
 
 #include "nanobenchmark.h"
 #include "randen.h"
+#include "timer.h"
 
 #include <stddef.h>
 #include <stdio.h>
@@ -22,7 +23,9 @@
 #include <time.h>  // clock_gettime
 #include <algorithm>  // sort
 #include <atomic>
+#include <chrono>
 #include <limits>
+#include <memory>
 #include <numeric>  // iota
 #include <string>
 #include <vector>
@@ -34,6 +37,7 @@
 #include <intrin.h>
 #else
 #include <cpuid.h>  // NOLINT
+#include <x86intrin.h>  // NOLINT __rdtsc
 #endif
 #elif defined(__powerpc64__) || defined(_M_PPC)
 #define NB_ARCH_PPC
@@ -51,7 +55,11 @@
 #include <windows.h>  // NOLINT
 #elif defined(__linux__)
 #define NB_OS_LINUX
+#include <linux/perf_event.h>  // NOLINT
 #include <sched.h>  // NOLINT
+#include <sys/ioctl.h>  // NOLINT
+#include <sys/syscall.h>  // NOLINT
+#include <unistd.h>  // NOLINT
 #else
 #error "Please add support for this OS"
 #endif
@@ -113,7 +121,7 @@ void Cpuid(const uint32_t level, const uint32_t count,
 #endif
 }
 
-std::string BrandString() {
+std::string CpuidBrandString() {
   char brand_string[49];
   uint32_t abcd[4];
 
@@ -134,7 +142,7 @@ std::string BrandString() {
 // Returns the frequency quoted inside the brand string. This does not
 // account for throttling nor Turbo Boost.
 double NominalClockRate() {
-  const std::string& brand_string = BrandString();
+  const std::string& brand_string = CpuidBrandString();
   // Brand strings include the maximum configured frequency. These prefixes are
   // defined by Intel CPUID documentation.
   const char* prefixes[3] = {"MHz", "GHz", "THz"};
@@ -154,6 +162,21 @@ double NominalClockRate() {
   return 0.0;
 }
 
+// Returns the TSC frequency measured against the OS monotonic clock. Used
+// if the brand string does not specify the frequency (e.g. in some VMs).
+double MeasuredClockRate() {
+  using Clock = std::chrono::steady_clock;
+  const Clock::time_point begin = Clock::now();
+  const uint64_t ticks_begin = __rdtsc();
+  Clock::time_point end;
+  do {
+    end = Clock::now();
+  } while (end - begin < std::chrono::milliseconds(20));
+  const uint64_t ticks_end = __rdtsc();
+  return (ticks_end - ticks_begin) /
+         std::chrono::duration<double>(end - begin).count();
+}
+
 #endif  // NB_ARCH_X86
 
 }  // namespace
@@ -195,210 +218,25 @@ double InvariantTicksPerSecond() {
   return __ppc_get_timebase_freq();
 #elif defined(NB_ARCH_X86)
   // We assume the TSC is invariant; it is on all recent Intel/AMD CPUs.
-  return NominalClockRate();
+  const double nominal = NominalClockRate();
+  return nominal != 0.0 ? nominal : MeasuredClockRate();
 #else
   // Fall back to clock_gettime nanoseconds.
   return 1E9;
 #endif
 }
 
-}  // namespace platform
-namespace {
-
-// Prevents the compiler from eliding the computations that led to "output".
-template <class T>
-inline void PreventElision(T&& output) {
-#ifndef _MSC_VER
-  // Works by indicating to the compiler that "output" is being read and
-  // modified. The +r constraint avoids unnecessary writes to memory, but only
-  // works for built-in types (typically FuncOutput).
-  asm volatile("" : "+r"(output) : : "memory");
-#else
-  // MSVC does not support inline assembly anymore (and never supported GCC's
-  // RTL constraints). Self-assignment with #pragma optimize("off") might be
-  // expected to prevent elision, but it does not with MSVC 2015. Type-punning
-  // with volatile pointers generates inefficient code on MSVC 2017.
-  static std::atomic<T> dummy(T{});
-  dummy.store(output, std::memory_order_relaxed);
-#endif
-}
-
-namespace timer {
-
-// Start/Stop return absolute timestamps and must be placed immediately before
-// and after the region to measure. We provide separate Start/Stop functions
-// because they use different fences.
-//
-// Background: RDTSC is not 'serializing'; earlier instructions may complete
-// after it, and/or later instructions may complete before it. 'Fences' ensure
-// regions' elapsed times are independent of such reordering. The only
-// documented unprivileged serializing instruction is CPUID, which acts as a
-// full fence (no reordering across it in either direction). Unfortunately
-// the latency of CPUID varies wildly (perhaps made worse by not initializing
-// its EAX input). Because it cannot reliably be deducted from the region's
-// elapsed time, it must not be included in the region to measure (i.e.
-// between the two RDTSC).
-//
-// The newer RDTSCP is sometimes described as serializing, but it actually
-// only serves as a half-fence with release semantics. Although all
-// instructions in the region will complete before the final timestamp is
-// captured, subsequent instructions may leak into the region and increase the
-// elapsed time. Inserting another fence after the final RDTSCP would prevent
-// such reordering without affecting the measured region.
-//
-// Fortunately, such a fence exists. The LFENCE instruction is only documented
-// to delay later loads until earlier loads are visible. However, Intel's
-// reference manual says it acts as a full fence (waiting until all earlier
-// instructions have completed, and delaying later instructions until it
-// completes). AMD assigns the same behavior to MFENCE.
-//
-// We need a fence before the initial RDTSC to prevent earlier instructions
-// from leaking into the region, and arguably another after RDTSC to avoid
-// region instructions from completing before the timestamp is recorded.
-// When surrounded by fences, the additional RDTSCP half-fence provides no
-// benefit, so the initial timestamp can be recorded via RDTSC, which has
-// lower overhead than RDTSCP because it does not read TSC_AUX. In summary,
-// we define Start = LFENCE/RDTSC/LFENCE; Stop = RDTSCP/LFENCE.
-//
-// Using Start+Start leads to higher variance and overhead than Stop+Stop.
-// However, Stop+Stop includes an LFENCE in the region measurements, which
-// adds a delay dependent on earlier loads. The combination of Start+Stop
-// is faster than Start+Start and more consistent than Stop+Stop because
-// the first LFENCE already delayed subsequent loads before the measured
-// region. This combination seems not to have been considered in prior work:
-// http://akaros.cs.berkeley.edu/lxr/akaros/kern/arch/x86/rdtsc_test.c
-//
-// Note: performance counters can measure 'exact' instructions-retired or
-// (unhalted) cycle counts. The RDPMC instruction is not serializing and also
-// requires fences. Unfortunately, it is not accessible on all OSes and we
-// prefer to avoid kernel-mode drivers. Performance counters are also affected
-// by several under/over-count errata, so we use the TSC instead.
-
-// Returns a 64-bit timestamp in unit of 'ticks'; to convert to seconds,
-// divide by InvariantTicksPerSecond.
-inline uint64_t Start64() {
-  uint64_t t;
-#if defined(NB_ARCH_PPC)
-  asm volatile("mfspr %0, %1" : "=r"(t) : "i"(268));
-#elif defined(NB_ARCH_X86)
-#if defined(_MSC_VER)
-  _ReadWriteBarrier();
-  _mm_lfence();
-  _ReadWriteBarrier();
-  t = __rdtsc();
-  _ReadWriteBarrier();
-  _mm_lfence();
-  _ReadWriteBarrier();
-#else
-  asm volatile(
-      "lfence\n\t"
-      "rdtsc\n\t"
-      "shl $32, %%rdx\n\t"
-      "or %%rdx, %0\n\t"
-      "lfence"
-      : "=a"(t)
-      :
-      // "memory" avoids reordering. rdx = TSC >> 32.
-      // "cc" = flags modified by SHL.
-      : "rdx", "memory", "cc");
-#endif
-#else
-  // Fall back to OS - unsure how to reliably query cntvct_el0 frequency.
-  timespec ts;
-  clock_gettime(CLOCK_MONOTONIC, &ts);
-  t = ts.tv_sec * 1000000000LL + ts.tv_nsec;
-#endif
-  return t;
-}
-
-inline uint64_t Stop64() {
-  uint64_t t;
-#if defined(NB_ARCH_PPC)
-  asm volatile("mfspr %0, %1" : "=r"(t) : "i"(268));
-#elif defined(NB_ARCH_X86)
-#if defined(_MSC_VER)
-  _ReadWriteBarrier();
-  unsigned aux;
-  t = __rdtscp(&aux);
-  _ReadWriteBarrier();
-  _mm_lfence();
-  _ReadWriteBarrier();
-#else
-  // Use inline asm because __rdtscp generates code to store TSC_AUX (ecx).
-  asm volatile(
-      "rdtscp\n\t"
-      "shl $32, %%rdx\n\t"
-      "or %%rdx, %0\n\t"
-      "lfence"
-      : "=a"(t)
-      :
-      // "memory" avoids reordering. rcx = TSC_AUX. rdx = TSC >> 32.
-      // "cc" = flags modified by SHL.
-      : "rcx", "rdx", "memory", "cc");
-#endif
-#else
-  t = Start64();
-#endif
-  return t;
-}
-
-// Returns a 32-bit timestamp with about 4 cycles less overhead than
-// Start64. Only suitable for measuring very short regions because the
-// timestamp overflows about once a second.
-inline uint32_t Start32() {
-  uint32_t t;
-#if defined(NB_ARCH_X86)
-#if defined(_MSC_VER)
-  _ReadWriteBarrier();
-  _mm_lfence();
-  _ReadWriteBarrier();
-  t = static_cast<uint32_t>(__rdtsc());
-  _ReadWriteBarrier();
-  _mm_lfence();
-  _ReadWriteBarrier();
-#else
-  asm volatile(
-      "lfence\n\t"
-      "rdtsc\n\t"
-      "lfence"
-      : "=a"(t)
-      :
-      // "memory" avoids reordering. rdx = TSC >> 32.
-      : "rdx", "memory");
-#endif
-#else
-  t = static_cast<uint32_t>(Start64());
-#endif
-  return t;
-}
-
-inline uint32_t Stop32() {
-  uint32_t t;
+const char* BrandString() {
 #if defined(NB_ARCH_X86)
-#if defined(_MSC_VER)
-  _ReadWriteBarrier();
-  unsigned aux;
-  t = static_cast<uint32_t>(__rdtscp(&aux));
-  _ReadWriteBarrier();
-  _mm_lfence();
-  _ReadWriteBarrier();
-#else
-  // Use inline asm because __rdtscp generates code to store TSC_AUX (ecx).
-  asm volatile(
-      "rdtscp\n\t"
-      "lfence"
-      : "=a"(t)
-      :
-      // "memory" avoids reordering. rcx = TSC_AUX. rdx = TSC >> 32.
-      : "rcx", "rdx", "memory");
-#endif
+  static const std::string brand_string = CpuidBrandString();
+  return brand_string.c_str();
 #else
-  t = static_cast<uint32_t>(Stop64());
+  return "";
 #endif
-  return t;
 }
 
-}  // namespace timer
+}  // namespace platform
+namespace {
 
 namespace robust_statistics {
 
@@ -519,20 +357,118 @@ T MedianAbsoluteDeviation(const T* values, const size_t num_values,
 
 }  // namespace robust_statistics
 
-// Ticks := platform-specific timer values (CPU cycles on x86). Must be
+namespace perf {
+
+enum { kCycles, kInstructions, kBranchMisses, kL1DMisses, kNumCounters };
+
+// Group of hardware event counters for the calling thread (user mode only,
+// which suffices for our purposes and is allowed with perf_event_paranoid=2).
+// Counters that cannot be opened are unavailable; this is the case for all
+// of them on other OSes, or in containers/VMs without perf events.
+class Counters {
+ public:
+  Counters() {
+    for (int i = 0; i < kNumCounters; ++i) {
+      fds_[i] = -1;
+    }
+#ifdef NB_OS_LINUX
+    const uint32_t types[kNumCounters] = {PERF_TYPE_HARDWARE,
+                                          PERF_TYPE_HARDWARE,
+                                          PERF_TYPE_HARDWARE,
+                                          PERF_TYPE_HW_CACHE};
+    const uint64_t configs[kNumCounters] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_BRANCH_MISSES,
+        PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)};
+    for (int i = 0; i < kNumCounters; ++i) {
+      perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = types[i];
+      attr.config = configs[i];
+      attr.read_format = PERF_FORMAT_GROUP;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.disabled = leader_ < 0;  // group is enabled via the leader
+      attr.pinned = leader_ < 0;    // avoids multiplexing
+      const long fd = syscall(__NR_perf_event_open, &attr, 0, -1, leader_, 0);
+      if (fd < 0) continue;
+      fds_[i] = static_cast<int>(fd);
+      position_[i] = num_open_++;
+      if (leader_ < 0) leader_ = fds_[i];
+    }
+    if (leader_ >= 0) {
+      ioctl(leader_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+      ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+#endif
+  }
+
+  ~Counters() {
+#ifdef NB_OS_LINUX
+    for (int i = 0; i < kNumCounters; ++i) {
+      if (fds_[i] >= 0) close(fds_[i]);
+    }
+#endif
+  }
+
+  Counters(const Counters&) = delete;
+  Counters& operator=(const Counters&) = delete;
+
+  bool Any() const { return leader_ >= 0; }
+  bool Available(const int idx) const { return fds_[idx] >= 0; }
+
+  // Stores the current counts; those of unavailable counters are zero.
+  void Read(uint64_t* NB_RESTRICT counts) const {
+    for (int i = 0; i < kNumCounters; ++i) {
+      counts[i] = 0;
+    }
+#ifdef NB_OS_LINUX
+    if (leader_ < 0) return;
+    uint64_t buf[1 + kNumCounters];  // number of values, then the values
+    if (read(leader_, buf, sizeof(buf)) <= 0) return;
+    for (int i = 0; i < kNumCounters; ++i) {
+      if (fds_[i] >= 0) counts[i] = buf[1 + position_[i]];
+    }
+#endif
+  }
+
+ private:
+  int fds_[kNumCounters];
+  int position_[kNumCounters] = {0};  // within the group's read buffer
+  int num_open_ = 0;
+  int leader_ = -1;
+};
+
+}  // namespace perf
+
+// Timer::Ticks := platform-specific timer values (CPU cycles on x86). Must be
 // unsigned to guarantee wraparound on overflow. 32 bit timers are faster to
-// read than 64 bit.
-using Ticks = uint32_t;
+// read than 64 bit, but only suitable for regions shorter than about a second.
+struct Timer32 {
+  using Ticks = uint32_t;
+  static Ticks Start() { return timer::Start32(); }
+  static Ticks Stop() { return timer::Stop32(); }
+};
+
+struct Timer64 {
+  using Ticks = uint64_t;
+  static Ticks Start() { return timer::Start64(); }
+  static Ticks Stop() { return timer::Stop64(); }
+};
 
 // Returns timer overhead / minimum measurable difference.
-Ticks TimerResolution() {
+template <class Timer>
+typename Timer::Ticks MeasureTimerResolution() {
+  using Ticks = typename Timer::Ticks;
   // Nested loop avoids exceeding stack/L1 capacity.
   Ticks repetitions[Params::kTimerSamples];
   for (size_t rep = 0; rep < Params::kTimerSamples; ++rep) {
     Ticks samples[Params::kTimerSamples];
     for (size_t i = 0; i < Params::kTimerSamples; ++i) {
-      const Ticks t0 = timer::Start32();
-      const Ticks t1 = timer::Stop32();
+      const Ticks t0 = Timer::Start();
+      const Ticks t1 = Timer::Stop();
       samples[i] = t1 - t0;
     }
     repetitions[rep] = robust_statistics::Mode(samples);
@@ -540,17 +476,27 @@ Ticks TimerResolution() {
   return robust_statistics::Mode(repetitions);
 }
 
-static const Ticks timer_resolution = TimerResolution();
+template <class Timer>
+typename Timer::Ticks TimerResolution() {
+  static const typename Timer::Ticks timer_resolution =
+      MeasureTimerResolution<Timer>();
+  return timer_resolution;
+}
 
 // Estimates the expected value of "lambda" values with a variable number of
-// samples until the variability "rel_mad" is less than "max_rel_mad".
-template <class Lambda>
-Ticks SampleUntilStable(const double max_rel_mad, double* rel_mad,
-                        const Params& p, const Lambda& lambda) {
+// samples until the variability "rel_mad" is less than "max_rel_mad". If
+// "counters" is non-null, also stores the median of each counter's
+// per-sample count in "counts".
+template <class Timer, class Lambda>
+typename Timer::Ticks SampleUntilStable(
+    const double max_rel_mad, double* rel_mad, const Params& p,
+    const Lambda& lambda, const perf::Counters* counters = nullptr,
+    uint64_t* counts = nullptr) {
+  using Ticks = typename Timer::Ticks;
   // Choose initial samples_per_eval based on a single estimated duration.
-  Ticks t0 = timer::Start32();
+  Ticks t0 = Timer::Start();
   lambda();
-  Ticks t1 = timer::Stop32();
+  Ticks t1 = Timer::Stop();
   Ticks est = t1 - t0;
   static const double ticks_per_second = platform::InvariantTicksPerSecond();
   const size_t ticks_per_eval =
@@ -561,19 +507,37 @@ Ticks SampleUntilStable(const double max_rel_mad, double* rel_mad,
   std::vector<Ticks> samples;
   samples.reserve(1 + samples_per_eval);
   samples.push_back(est);
+  std::vector<uint64_t> count_samples[perf::kNumCounters];
 
   // Percentage is too strict for tiny differences, so also allow a small
   // absolute "median absolute deviation".
-  const Ticks max_abs_mad = (timer_resolution + 99) / 100;
+  const Ticks max_abs_mad = (TimerResolution<Timer>() + 99) / 100;
   *rel_mad = 0.0;  // ensure initialized
 
   for (size_t eval = 0; eval < p.max_evals; ++eval, samples_per_eval *= 2) {
     samples.reserve(samples.size() + samples_per_eval);
     for (size_t i = 0; i < samples_per_eval; ++i) {
-      t0 = timer::Start32();
+      // Reading the counters is slow, hence outside the timed region. Its
+      // cost is constant and thus deducted by Overhead.
+      uint64_t before[perf::kNumCounters];
+      if (counters != nullptr) counters->Read(before);
+      t0 = Timer::Start();
       lambda();
-      t1 = timer::Stop32();
+      t1 = Timer::Stop();
       samples.push_back(t1 - t0);
+      if (counters != nullptr) {
+        uint64_t after[perf::kNumCounters];
+        counters->Read(after);
+        for (int c = 0; c < perf::kNumCounters; ++c) {
+          count_samples[c].push_back(after[c] - before[c]);
+        }
+      }
+    }
+    if (counters != nullptr) {
+      for (int c = 0; c < perf::kNumCounters; ++c) {
+        std::vector<uint64_t> copy = count_samples[c];
+        counts[c] = robust_statistics::Median(copy.data(), copy.size());
+      }
     }
 
     if (samples.size() >= p.min_mode_samples) {
@@ -587,12 +551,13 @@ Ticks SampleUntilStable(const double max_rel_mad, double* rel_mad,
     // Median absolute deviation (mad) is a robust measure of 'variability'.
     const Ticks abs_mad = robust_statistics::MedianAbsoluteDeviation(
         samples.data(), samples.size(), est);
-    *rel_mad = static_cast<double>(int(abs_mad)) / est;
+    *rel_mad = static_cast<double>(abs_mad) / est;
 
     if (*rel_mad <= max_rel_mad || abs_mad <= max_abs_mad) {
       if (p.verbose) {
-        printf("%6zu samples => %5u (abs_mad=%4u, rel_mad=%4.2f%%)\n",
-               samples.size(), est, abs_mad, *rel_mad * 100.0);
+        printf("%6zu samples => %5llu (abs_mad=%4llu, rel_mad=%4.2f%%)\n",
+               samples.size(), static_cast<unsigned long long>(est),
+               static_cast<unsigned long long>(abs_mad), *rel_mad * 100.0);
       }
       return est;
     }
@@ -616,27 +581,50 @@ InputVec UniqueInputs(const FuncInput* inputs, const size_t num_inputs) {
   return unique;
 }
 
+// Returns whether 32-bit ticks suffice for measuring "inputs". This is the
+// case if the duration of all calls to "func" per sample (see
+// ReplicateInputs) is comfortably below 2^32, based on a single call per
+// unique input.
+bool Fits32BitTicks(const Func func, const uint8_t* arg,
+                    const FuncInput* inputs, const size_t num_inputs,
+                    const InputVec& unique, const Params& p) {
+  std::vector<uint64_t> elapsed(unique.size());
+  for (size_t i = 0; i < unique.size(); ++i) {
+    const uint64_t t0 = timer::Start64();
+    PreventElision(func(arg, unique[i]));
+    const uint64_t t1 = timer::Stop64();
+    elapsed[i] = std::max<uint64_t>(t1 - t0, 1);
+  }
+
+  // Estimate of the NumSkip return value, and thus number of repetitions.
+  const uint64_t min_elapsed =
+      *std::min_element(elapsed.begin(), elapsed.end());
+  const uint64_t num_skip =
+      (p.precision_divisor + min_elapsed - 1) / min_elapsed;
+  double total = 0.0;
+  for (size_t i = 0; i < num_inputs; ++i) {
+    const size_t idx =
+        std::lower_bound(unique.begin(), unique.end(), inputs[i]) -
+        unique.begin();
+    total += static_cast<double>(elapsed[idx]);
+  }
+  total *= static_cast<double>(p.subset_ratio * num_skip);
+  return total < static_cast<double>(1ULL << 30);
+}
+
 // Returns how often we need to call func for sufficient precision, or zero
-// on failure (e.g. the elapsed time is too long for a 32-bit tick count).
+// on failure.
+template <class Timer>
 size_t NumSkip(const Func func, const uint8_t* arg, const InputVec& unique,
                const Params& p) {
+  using Ticks = typename Timer::Ticks;
+  const Ticks timer_resolution = TimerResolution<Timer>();
   // Min elapsed ticks for any input.
-  Ticks min_duration = ~0u;
+  Ticks min_duration = ~Ticks(0);
 
   for (const FuncInput input : unique) {
-    // Make sure a 32-bit timer is sufficient.
-    const uint64_t t0 = timer::Start64();
-    PreventElision(func(arg, input));
-    const uint64_t t1 = timer::Stop64();
-    const uint64_t elapsed = t1 - t0;
-    if (elapsed >= (1ULL << 30)) {
-      fprintf(stderr, "Measurement failed: need 64-bit timer for input=%zu\n",
-              input);
-      return 0;
-    }
-
     double rel_mad;
-    const Ticks total = SampleUntilStable(
+    const Ticks total = SampleUntilStable<Timer>(
         p.target_rel_mad, &rel_mad, p,
         [func, arg, input]() { PreventElision(func(arg, input)); });
     min_duration = std::min(min_duration, total - timer_resolution);
@@ -648,8 +636,9 @@ size_t NumSkip(const Func func, const uint8_t* arg, const InputVec& unique,
   const size_t num_skip =
       min_duration == 0 ? 0 : (max_skip + min_duration - 1) / min_duration;
   if (p.verbose) {
-    printf("res=%u max_skip=%zu min_dur=%u num_skip=%zu\n", timer_resolution,
-           max_skip, min_duration, num_skip);
+    printf("res=%llu max_skip=%zu min_dur=%llu num_skip=%zu\n",
+           static_cast<unsigned long long>(timer_resolution), max_skip,
+           static_cast<unsigned long long>(min_duration), num_skip);
   }
   return num_skip;
 }
@@ -712,16 +701,23 @@ void FillSubset(const InputVec& full, const FuncInput input_to_skip,
   NANOBENCHMARK_CHECK(occurrence == count - 1);
 }
 
-// Returns total ticks elapsed for all inputs.
-Ticks TotalDuration(const Func func, const uint8_t* arg, const InputVec* inputs,
-                    const Params& p, double* max_rel_mad) {
+// Returns total ticks elapsed for all inputs, and the counts of "counters"
+// if non-null.
+template <class Timer>
+typename Timer::Ticks TotalDuration(const Func func, const uint8_t* arg,
+                                    const InputVec* inputs, const Params& p,
+                                    double* max_rel_mad,
+                                    const perf::Counters* counters,
+                                    uint64_t* counts) {
   double rel_mad;
-  const Ticks duration =
-      SampleUntilStable(p.target_rel_mad, &rel_mad, p, [func, arg, inputs]() {
+  const typename Timer::Ticks duration = SampleUntilStable<Timer>(
+      p.target_rel_mad, &rel_mad, p,
+      [func, arg, inputs]() {
         for (const FuncInput input : *inputs) {
           PreventElision(func(arg, input));
         }
-      });
+      },
+      counters, counts);
   *max_rel_mad = std::max(*max_rel_mad, rel_mad);
   return duration;
 }
@@ -733,53 +729,99 @@ NB_NOINLINE FuncOutput EmptyFunc(const void* arg, const FuncInput input) {
 
 // Returns overhead of accessing inputs[] and calling a function; this will
 // be deducted from future TotalDuration return values.
-Ticks Overhead(const uint8_t* arg, const InputVec* inputs, const Params& p) {
+template <class Timer>
+typename Timer::Ticks Overhead(const uint8_t* arg, const InputVec* inputs,
+                               const Params& p, const perf::Counters* counters,
+                               uint64_t* counts) {
   double rel_mad;
   // Zero tolerance because repeatability is crucial and EmptyFunc is fast.
-  return SampleUntilStable(0.0, &rel_mad, p, [arg, inputs]() {
-    for (const FuncInput input : *inputs) {
-      PreventElision(EmptyFunc(arg, input));
-    }
-  });
+  return SampleUntilStable<Timer>(0.0, &rel_mad, p,
+                                  [arg, inputs]() {
+                                    for (const FuncInput input : *inputs) {
+                                      PreventElision(EmptyFunc(arg, input));
+                                    }
+                                  },
+                                  counters, counts);
 }
 
-}  // namespace
-
-size_t Measure(const Func func, const uint8_t* arg, const FuncInput* inputs,
-               const size_t num_inputs, Result* results, const Params& p) {
-  NANOBENCHMARK_CHECK(num_inputs != 0);
-  const InputVec& unique = UniqueInputs(inputs, num_inputs);
+// Stores the events per call in "events", analogous to the ticks per call.
+void SetEvents(const perf::Counters* counters, const uint64_t* total,
+               const uint64_t* overhead, const uint64_t* total_skip,
+               const uint64_t* overhead_skip, const double mul,
+               PerfCounts* events) {
+  double per_call[perf::kNumCounters];
+  for (int c = 0; c < perf::kNumCounters; ++c) {
+    per_call[c] = -1.0;
+    if (counters == nullptr || !counters->Available(c)) continue;
+    // Signed because noise may cause small negative differences.
+    const double diff = (static_cast<double>(total[c]) - overhead[c]) -
+                        (static_cast<double>(total_skip[c]) - overhead_skip[c]);
+    per_call[c] = std::max(0.0, diff * mul);
+  }
+  events->cycles = per_call[perf::kCycles];
+  events->instructions = per_call[perf::kInstructions];
+  events->branch_misses = per_call[perf::kBranchMisses];
+  events->l1d_misses = per_call[perf::kL1DMisses];
+}
 
-  const size_t num_skip = NumSkip(func, arg, unique, p);  // never 0
-  if (num_skip == 0) return 0;  // NumSkip already printed error message
-  const float mul = 1.0f / static_cast<int>(num_skip);
+template <class Timer>
+size_t MeasureWithTimer(const Func func, const uint8_t* arg,
+                        const FuncInput* inputs, const size_t num_inputs,
+                        const InputVec& unique, Result* results,
+                        const Params& p) {
+  using Ticks = typename Timer::Ticks;
+  const size_t num_skip = NumSkip<Timer>(func, arg, unique, p);
+  if (num_skip == 0) {
+    fprintf(stderr, "Measurement failed: zero duration\n");
+    return 0;
+  }
+  const double mul = 1.0 / static_cast<double>(num_skip);
 
   const InputVec& full =
       ReplicateInputs(inputs, num_inputs, unique.size(), num_skip, p);
   InputVec subset(full.size() - num_skip);
 
-  const Ticks overhead = Overhead(arg, &full, p);
-  const Ticks overhead_skip = Overhead(arg, &subset, p);
+  // Only opened if requested because reading them slows down sampling.
+  std::unique_ptr<perf::Counters> counters;
+  if (p.perf_counters) {
+    counters.reset(new perf::Counters);
+    if (!counters->Any()) {
+      if (p.verbose) printf("Perf counters unavailable\n");
+      counters.reset();
+    }
+  }
+  uint64_t counts[4][perf::kNumCounters] = {{0}};
+
+  const Ticks overhead =
+      Overhead<Timer>(arg, &full, p, counters.get(), counts[0]);
+  const Ticks overhead_skip =
+      Overhead<Timer>(arg, &subset, p, counters.get(), counts[1]);
   if (overhead < overhead_skip) {
-    fprintf(stderr, "Measurement failed: overhead %u < %u\n", overhead,
-            overhead_skip);
+    fprintf(stderr, "Measurement failed: overhead %llu < %llu\n",
+            static_cast<unsigned long long>(overhead),
+            static_cast<unsigned long long>(overhead_skip));
     return 0;
   }
 
   if (p.verbose) {
-    printf("#inputs=%5zu,%5zu overhead=%5u,%5u\n", full.size(), subset.size(),
-           overhead, overhead_skip);
+    printf("#inputs=%5zu,%5zu overhead=%5llu,%5llu\n", full.size(),
+           subset.size(), static_cast<unsigned long long>(overhead),
+           static_cast<unsigned long long>(overhead_skip));
   }
 
   double max_rel_mad = 0.0;
-  const Ticks total = TotalDuration(func, arg, &full, p, &max_rel_mad);
+  const Ticks total = TotalDuration<Timer>(func, arg, &full, p, &max_rel_mad,
+                                           counters.get(), counts[2]);
 
   for (size_t i = 0; i < unique.size(); ++i) {
     FillSubset(full, unique[i], num_skip, &subset);
-    const Ticks total_skip = TotalDuration(func, arg, &subset, p, &max_rel_mad);
+    const Ticks total_skip = TotalDuration<Timer>(
+        func, arg, &subset, p, &max_rel_mad, counters.get(), counts[3]);
 
     if (total < total_skip) {
-      fprintf(stderr, "Measurement failed: total %u < %u\n", total, total_skip);
+      fprintf(stderr, "Measurement failed: total %llu < %llu\n",
+              static_cast<unsigned long long>(total),
+              static_cast<unsigned long long>(total_skip));
       return 0;
     }
 
@@ -787,9 +829,142 @@ size_t Measure(const Func func, const uint8_t* arg, const FuncInput* inputs,
     results[i].input = unique[i];
     results[i].ticks = duration * mul;
     results[i].variability = static_cast<float>(max_rel_mad);
+    SetEvents(counters.get(), counts[2], counts[0], counts[3], counts[1], mul,
+              &results[i].events);
+  }
+
+  return unique.size();
+}
+
+// Returns ticks elapsed for "reps" calls of "func" with the same input.
+template <class Timer>
+typename Timer::Ticks TimeReps(const Func func, const uint8_t* arg,
+                               const FuncInput input, const size_t reps) {
+  const typename Timer::Ticks t0 = Timer::Start();
+  for (size_t i = 0; i < reps; ++i) {
+    PreventElision(func(arg, input));
+  }
+  const typename Timer::Ticks t1 = Timer::Stop();
+  return t1 - t0;
+}
+
+// Returns the median of "values". Side effect: reorders "values".
+double MedianOf(std::vector<double>* values) {
+  const size_t half = values->size() / 2;
+  std::nth_element(values->begin(), values->begin() + half, values->end());
+  return (*values)[half];
+}
+
+// Compares func_a and func_b for a single input; see MeasureCompare.
+CompareResult CompareInput(const Func func_a, const uint8_t* arg_a,
+                           const Func func_b, const uint8_t* arg_b,
+                           const FuncInput input, const Params& p) {
+  // 64-bit because the repetitions may take long.
+  using Timer = Timer64;
+  using Ticks = typename Timer::Ticks;
+
+  // Warm up, then choose the repetitions per sample as in NumSkip.
+  PreventElision(func_a(arg_a, input));
+  PreventElision(func_b(arg_b, input));
+  const Ticks est_a =
+      std::max<Ticks>(TimeReps<Timer>(func_a, arg_a, input, 1), 1);
+  const Ticks est_b =
+      std::max<Ticks>(TimeReps<Timer>(func_b, arg_b, input, 1), 1);
+  const Ticks min_est = std::min(est_a, est_b);
+  const size_t reps = (p.precision_divisor + min_est - 1) / min_est;
+
+  // Deducted from each sample: timer and loop overhead.
+  double rel_mad;
+  const uint8_t* empty_arg = nullptr;
+  const Ticks overhead =
+      SampleUntilStable<Timer>(0.0, &rel_mad, p, [empty_arg, input, reps]() {
+        for (size_t i = 0; i < reps; ++i) {
+          PreventElision(EmptyFunc(empty_arg, input));
+        }
+      });
+
+  // Spend about as much time as Measure; the bootstrap cost is proportional
+  // to the number of pairs, hence the upper bound.
+  static const double ticks_per_second = platform::InvariantTicksPerSecond();
+  const double budget = ticks_per_second * p.seconds_per_eval * p.max_evals;
+  const size_t kMaxPairs = 4096;
+  const size_t num_pairs = std::min(
+      kMaxPairs,
+      std::max(p.min_mode_samples,
+               static_cast<size_t>(budget / (reps * double(est_a + est_b)))));
+
+  std::vector<double> ratios;
+  ratios.reserve(num_pairs);
+  for (size_t pair = 0; pair < num_pairs; ++pair) {
+    Ticks ticks_a, ticks_b;
+    // Alternate the order to cancel effects of the preceding function.
+    if (pair & 1) {
+      ticks_b = TimeReps<Timer>(func_b, arg_b, input, reps);
+      ticks_a = TimeReps<Timer>(func_a, arg_a, input, reps);
+    } else {
+      ticks_a = TimeReps<Timer>(func_a, arg_a, input, reps);
+      ticks_b = TimeReps<Timer>(func_b, arg_b, input, reps);
+    }
+    ticks_a = ticks_a > overhead ? ticks_a - overhead : 1;
+    ticks_b = ticks_b > overhead ? ticks_b - overhead : 1;
+    ratios.push_back(static_cast<double>(ticks_b) / ticks_a);
+  }
+
+  CompareResult result;
+  result.input = input;
+  result.num_pairs = num_pairs;
+  std::vector<double> copy = ratios;
+  result.ratio = MedianOf(&copy);
+
+  // Percentile bootstrap of the median.
+  const size_t kResamples = 1000;
+  std::vector<double> medians(kResamples);
+  randen::Randen<uint32_t> rng;
+  for (double& median : medians) {
+    for (double& ratio : copy) {
+      ratio = ratios[rng() % num_pairs];
+    }
+    median = MedianOf(&copy);
   }
+  std::sort(medians.begin(), medians.end());
+  result.ratio_lower = medians[kResamples * 25 / 1000];
+  result.ratio_upper = medians[kResamples * 975 / 1000];
 
+  if (p.verbose) {
+    printf("input=%zu reps=%zu overhead=%llu pairs=%zu ratio=%.4f "
+           "[%.4f, %.4f]\n",
+           input, reps, static_cast<unsigned long long>(overhead), num_pairs,
+           result.ratio, result.ratio_lower, result.ratio_upper);
+  }
+  return result;
+}
+
+}  // namespace
+
+size_t MeasureCompare(const Func func_a, const uint8_t* arg_a,
+                      const Func func_b, const uint8_t* arg_b,
+                      const FuncInput* inputs, const size_t num_inputs,
+                      CompareResult* results, const Params& p) {
+  NANOBENCHMARK_CHECK(num_inputs != 0);
+  const InputVec& unique = UniqueInputs(inputs, num_inputs);
+  for (size_t i = 0; i < unique.size(); ++i) {
+    results[i] = CompareInput(func_a, arg_a, func_b, arg_b, unique[i], p);
+  }
   return unique.size();
 }
 
+size_t Measure(const Func func, const uint8_t* arg, const FuncInput* inputs,
+               const size_t num_inputs, Result* results, const Params& p) {
+  NANOBENCHMARK_CHECK(num_inputs != 0);
+  const InputVec& unique = UniqueInputs(inputs, num_inputs);
+
+  if (Fits32BitTicks(func, arg, inputs, num_inputs, unique, p)) {
+    return MeasureWithTimer<Timer32>(func, arg, inputs, num_inputs, unique,
+                                     results, p);
+  }
+  if (p.verbose) printf("Using 64-bit timer\n");
+  return MeasureWithTimer<Timer64>(func, arg, inputs, num_inputs, unique,
+                                   results, p);
+}
+
 }  // namespace randen
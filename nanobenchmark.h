@@ -66,6 +66,10 @@ void PinThreadToCPU(const int cpu = -1);
 // This call may be expensive, callers should cache the result.
 double InvariantTicksPerSecond();
 
+// Returns the CPU brand string (e.g. to identify where benchmark results were
+// obtained), or an empty string if unavailable.
+const char* BrandString();
+
 }  // namespace platform
 
 // Input influencing the function being measured (e.g. number of bytes to copy).
@@ -117,17 +121,34 @@ struct Params {
 
   // Whether to print additional statistics to stdout.
   bool verbose = true;
+
+  // Whether to also count hardware events via Linux perf_event_open (see
+  // Result::events). Increases measurement time due to the syscalls.
+  bool perf_counters = false;
+};
+
+// Hardware events per call, estimated like Result::ticks, or negative if
+// unavailable (e.g. not Linux, or inside containers/VMs without perf events).
+struct PerfCounts {
+  double cycles;         // core clock cycles; unlike ticks, affected by turbo
+  double instructions;   // retired instructions
+  double branch_misses;  // mispredicted branches
+  double l1d_misses;     // L1 data cache read misses
 };
 
 // Measurement result for each unique input.
 struct Result {
   FuncInput input;
 
-  // Robust estimate (mode or median) of duration.
-  float ticks;
+  // Robust estimate (mode or median) of duration. Double because durations
+  // may exceed 2^32 ticks (and the 24-bit precision of float).
+  double ticks;
 
   // Measure of variability (median absolute deviation relative to "ticks").
   float variability;
+
+  // Only valid if Params::perf_counters.
+  PerfCounts events;
 };
 
 // Precisely measures the number of ticks elapsed when calling "func" with the
@@ -142,10 +163,40 @@ struct Result {
 //   uniform distribution over [0, 4) could be represented as {3,0,2,1}.
 // Returns how many Result were written to "results": one per unique input, or
 //   zero if the measurement failed (an error message goes to stderr).
+// Uses 64-bit timestamps if the calls are too long for 32-bit ticks.
 size_t Measure(const Func func, const uint8_t* arg, const FuncInput* inputs,
                const size_t num_inputs, Result* results,
                const Params& p = Params());
 
+// A/B comparison result for each unique input.
+struct CompareResult {
+  FuncInput input;
+
+  // Robust estimate (median) of duration(func_b) / duration(func_a), e.g.
+  // 0.97 means func_b is 3% faster.
+  double ratio;
+
+  // 95% confidence interval of "ratio". The difference is significant if it
+  // does not contain 1.
+  double ratio_lower;
+  double ratio_upper;
+
+  // Number of (interleaved) samples of each function.
+  size_t num_pairs;
+};
+
+// Compares the duration of "func_a" and "func_b" for each unique input.
+// Samples of the two functions are interleaved (alternating which runs first)
+// so that frequency drift and other slow changes affect both equally; the
+// confidence interval is obtained by bootstrapping the per-pair ratios.
+// Unlike Measure, each sample calls the function repeatedly with the same
+// input. Returns how many CompareResult were written to "results", i.e. one
+// per unique input.
+size_t MeasureCompare(const Func func_a, const uint8_t* arg_a,
+                      const Func func_b, const uint8_t* arg_b,
+                      const FuncInput* inputs, const size_t num_inputs,
+                      CompareResult* results, const Params& p = Params());
+
 // Per-copt namespace prevents leaking generated code into other modules.
 namespace NB_NAMESPACE {
 
@@ -169,6 +220,22 @@ static inline size_t MeasureClosure(const Closure& closure,
                  results, p);
 }
 
+// Same as MeasureCompare, but for lambda functions with capture lists.
+template <class ClosureA, class ClosureB>
+static inline size_t MeasureCompareClosures(const ClosureA& closure_a,
+                                            const ClosureB& closure_b,
+                                            const FuncInput* inputs,
+                                            const size_t num_inputs,
+                                            CompareResult* results,
+                                            const Params& p = Params()) {
+  return MeasureCompare(
+      reinterpret_cast<Func>(&NB_NAMESPACE::CallClosure<ClosureA>),
+      reinterpret_cast<const uint8_t*>(&closure_a),
+      reinterpret_cast<Func>(&NB_NAMESPACE::CallClosure<ClosureB>),
+      reinterpret_cast<const uint8_t*>(&closure_b), inputs, num_inputs, results,
+      p);
+}
+
 }  // namespace randen
 
 #endif  // NANOBENCHMARK_H_
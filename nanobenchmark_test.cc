@@ -89,20 +89,83 @@ void MeasureRandom(const FuncInput (&inputs)[N]) {
   }
 }
 
+// Perf counters are optional; if available, they must be plausible.
 template <size_t N>
-void EnsureLongMeasurementFails(const FuncInput (&inputs)[N]) {
-  printf("Expect a 'measurement failed' below:\n");
+void MeasurePerfCounters(const FuncInput (&inputs)[N]) {
   Result results[N];
+  Params p;
+  p.max_evals = 4;  // avoid test timeout
+  p.verbose = false;
+  p.perf_counters = true;
+  const size_t num_results = Measure(&AES, nullptr, inputs, N, results, p);
+  for (size_t i = 0; i < num_results; ++i) {
+    const PerfCounts& events = results[i].events;
+    printf("%5zu: cycles %6.2f instructions %6.2f branch misses %4.2f "
+           "L1D misses %4.2f\n",
+           results[i].input, events.cycles, events.instructions,
+           events.branch_misses, events.l1d_misses);
+    if (events.instructions >= 0.0) {
+      // At least one AESENC per round.
+      RANDEN_CHECK(events.instructions >= results[i].input);
+    }
+  }
+}
+
+// Twice as many AES rounds must be detectably slower; identical functions
+// must not differ much.
+template <size_t N>
+void CompareAES(const FuncInput (&inputs)[N]) {
+  CompareResult results[N];
+  Params p;
+  p.verbose = false;
+  const size_t num_results = MeasureCompareClosures(
+      [](const FuncInput input) { return AES(nullptr, input); },
+      [](const FuncInput input) { return AES(nullptr, 2 * input); }, inputs, N,
+      results, p);
+  RANDEN_CHECK(num_results == N);
+  for (size_t i = 0; i < num_results; ++i) {
+    printf("%5zu: 2x rounds ratio %4.2f [%4.2f, %4.2f]\n", results[i].input,
+           results[i].ratio, results[i].ratio_lower, results[i].ratio_upper);
+    RANDEN_CHECK(results[i].ratio_lower <= results[i].ratio);
+    RANDEN_CHECK(results[i].ratio <= results[i].ratio_upper);
+    RANDEN_CHECK(results[i].ratio_lower > 1.0);
+  }
+
+  const size_t num_same = MeasureCompare(&AES, nullptr, &AES, nullptr, inputs,
+                                         N, results, p);
+  RANDEN_CHECK(num_same == N);
+  for (size_t i = 0; i < num_same; ++i) {
+    printf("%5zu: same ratio %4.2f [%4.2f, %4.2f]\n", results[i].input,
+           results[i].ratio, results[i].ratio_lower, results[i].ratio_upper);
+    RANDEN_CHECK(0.8 < results[i].ratio && results[i].ratio < 1.25);
+  }
+}
+
+// Calls longer than 2^30 ticks require 64-bit timestamps.
+void MeasureLong() {
+  const FuncInput inputs[1] = {1};
+  Result results[1];
+  Params p;
+  // Avoid test timeout: each sample takes a second.
+  p.min_samples_per_eval = 1;
+  p.max_evals = 1;
+  p.verbose = false;
   const size_t num_results = MeasureClosure(
       [](const FuncInput input) {
         // Loop until the sleep succeeds (not interrupted by signal). We assume
-        // >= 512 MHz, so 2 seconds will exceed the 1 << 30 tick safety limit.
-        while (sleep(2) != 0) {
+        // >= 512 MHz, so this will exceed the 1 << 30 tick limit of the
+        // 32-bit timer path.
+        while (sleep(input) != 0) {
         }
         return input;
       },
-      inputs, N, results);
-  RANDEN_CHECK(num_results == 0);
+      inputs, 1, results, p);
+  RANDEN_CHECK(num_results == 1);
+  const double seconds =
+      results[0].ticks / platform::InvariantTicksPerSecond();
+  printf("%5zu: %6.3f seconds; MAD=%4.2f%%\n", results[0].input, seconds,
+         results[0].variability * 100.0);
+  RANDEN_CHECK(0.9 < seconds && seconds < 1.5);
 }
 
 void RunAll(const int argc, char* argv[]) {
@@ -121,7 +184,9 @@ void RunAll(const int argc, char* argv[]) {
   MeasureAES(inputs);
   MeasureDiv(inputs);
   MeasureRandom(inputs);
-  EnsureLongMeasurementFails(inputs);
+  MeasurePerfCounters(inputs);
+  CompareAES(inputs);
+  MeasureLong();
 }
 
 }  // namespace
@@ -27,8 +27,26 @@
 #include <iterator>
 #include <limits>
 #include <ostream>
+#include <string>
 #include <type_traits>
 
+// Opt-in statistics (see GetRandenStats). Must be the same for randen.cc and
+// all its users; Randen<T> then has a distinct name (see below).
+#ifndef RANDEN_STATS
+#define RANDEN_STATS 0
+#endif
+
+// Opt-in: whether Randen<T> calls the inline implementation in randen_inl.h
+// instead of the Internal functions in randen.cc, which enables inlining the
+// refill. May differ between translation units.
+#ifndef RANDEN_HEADER_ONLY
+#define RANDEN_HEADER_ONLY 0
+#endif
+
+#if RANDEN_HEADER_ONLY && RANDEN_STATS
+#error "RANDEN_STATS requires randen.cc"
+#endif
+
 // RANDen = RANDom generator or beetroots in Swiss German.
 namespace randen {
 
@@ -36,11 +54,265 @@ struct Internal {
   static void Absorb(const void* seed, void* state);
   static void Generate(void* state);
 
+  // Same result as Generate(state0) and Generate(state1), but faster if
+  // compiled with -mvaes.
+  static void Generate2(void* state0, void* state1);
+
+  // Calls Generate "num_buffers" times and writes the rate part of each (i.e.
+  // excluding the capacity) to consecutive locations starting at the 8-byte
+  // aligned "out" using non-temporal stores (faster if 16-byte aligned).
+  static void GenerateStream(void* state, void* out, size_t num_buffers);
+
   static constexpr int kStateBytes = 256;  // 2048-bit
 
   // Size of the 'inner' (inaccessible) part of the sponge. Larger values would
   // require more frequent calls to Generate.
   static constexpr int kCapacityBytes = 16;  // 128-bit
+
+  // Hooks for measuring the stages of Generate separately (see
+  // randen_components_benchmark.cc). Not intended for other uses.
+
+  // 17 rounds of 8 round keys, each 16 bytes.
+  static constexpr int kRounds = 17;
+  static constexpr int kKeyBytes = kRounds * 8 * 16;
+  static const void* Keys();
+
+  // Generate without the SwapIfBigEndian and capacity XOR.
+  static void Permute(void* state);
+
+  // Applies one round with the given keys (initially Keys()) and returns the
+  // keys for the next round.
+  static const void* FeistelRound(void* state, const void* keys);
+
+  static void BlockShuffle(void* state);
+
+#if RANDEN_STATS
+  // Adds to the current thread's counters (see GetRandenStats). Generate
+  // counts itself.
+  static void CountServed(uint64_t bytes);
+  static void CountReseed();
+  static void CountDiscard();
+#endif
+};
+
+#if RANDEN_STATS
+// Totals for all Randen engines.
+struct RandenStats {
+  uint64_t generate_calls;  // buffer refills, including those in discard
+  uint64_t bytes_served;    // returned by operator()
+  uint64_t reseeds;
+  uint64_t discards;
+};
+
+// Returns the sum of all threads' counters, including threads that have
+// exited. For efficiency, engines only count bytes served when they refill,
+// reseed, discard or are destroyed, so up to 240 bytes per live engine may be
+// missing. (Copying an engine also copies its uncounted bytes.) Each thread's
+// counters only cost a thread-local increment per refill or reseed.
+RandenStats GetRandenStats();
+#endif
+
+// One component of the path passed to Randen::ForStream: an integer (converted
+// to uint64_t, so 5 and 5u are the same key) or a byte string. Integers and
+// strings are distinct even if their bytes are the same.
+class StreamKey {
+ public:
+  template <typename Int, typename = typename std::enable_if<
+                              std::is_integral<Int>::value>::type>
+  StreamKey(const Int value)  // NOLINT(runtime/explicit)
+      : bytes_(nullptr), size_(sizeof(uint64_t)), tag_(kInteger) {
+    StoreLittleEndian(static_cast<uint64_t>(value), integer_);
+  }
+
+  StreamKey(const char* str)  // NOLINT(runtime/explicit)
+      : StreamKey(str, strlen(str)) {}
+  StreamKey(const std::string& str)  // NOLINT(runtime/explicit)
+      : StreamKey(str.data(), str.size()) {}
+  StreamKey(const void* bytes, const size_t size)
+      : bytes_(static_cast<const uint8_t*>(bytes)),
+        size_(size),
+        tag_(kBytes) {}
+
+  // Each block is XORed into the rate, followed by a permutation.
+  static constexpr size_t kBlockBytes =
+      Internal::kStateBytes - Internal::kCapacityBytes;
+
+  // The first block begins with a header; the encoding of each key is
+  // therefore unique, and keys of up to 232 bytes require only one block.
+  size_t NumBlocks() const {
+    return (size_ + kHeaderBytes + kBlockBytes - 1) / kBlockBytes;
+  }
+
+  // Writes block "index" < NumBlocks().
+  void EncodeBlock(const size_t index, uint8_t (&block)[kBlockBytes]) const {
+    memset(block, 0, kBlockBytes);
+    const uint8_t* data = (tag_ == kInteger) ? integer_ : bytes_;
+    size_t begin = 0;  // within the data
+    uint8_t* out = block;
+    if (index == 0) {
+      StoreLittleEndian((static_cast<uint64_t>(size_) << 8) | tag_, block);
+      out += kHeaderBytes;
+    } else {
+      begin = index * kBlockBytes - kHeaderBytes;
+    }
+    const size_t capacity = static_cast<size_t>(block + kBlockBytes - out);
+    const size_t end = std::min(size_, begin + capacity);
+    if (end > begin) memcpy(out, data + begin, end - begin);
+  }
+
+ private:
+  static constexpr size_t kHeaderBytes = sizeof(uint64_t);
+  static constexpr uint8_t kInteger = 1;
+  static constexpr uint8_t kBytes = 2;
+
+  static void StoreLittleEndian(const uint64_t value, uint8_t* bytes) {
+    for (size_t i = 0; i < sizeof(value); ++i) {
+      bytes[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+  }
+
+  const uint8_t* bytes_;  // unless kInteger
+  size_t size_;
+  uint8_t tag_;
+  uint8_t integer_[sizeof(uint64_t)];
+};
+
+}  // namespace randen
+
+#if RANDEN_HEADER_ONLY
+#include "randen_inl.h"  // requires Internal
+#endif
+
+namespace randen {
+
+// Distinct (mangled) names for the configurations, so that mixing them in one
+// program does not violate the one-definition rule (RANDEN_STATS also changes
+// the layout of Randen).
+#if RANDEN_HEADER_ONLY
+inline namespace header_only {
+#elif RANDEN_STATS
+inline namespace stats {
+#endif
+
+// Refills the state of Randen (an array of kBufferBytes) using the
+// permutation with all rounds. See Internal for the functions.
+struct RandenSponge {
+  static constexpr int kBufferBytes = Internal::kStateBytes;
+
+  template <typename T, size_t N>
+  static void Absorb(const void* seed, T (&state)[N]) {
+#if RANDEN_HEADER_ONLY
+    inl::Absorb(static_cast<const uint64_t*>(seed), inl::Lanes(state));
+#else
+    Internal::Absorb(seed, state);
+#endif
+  }
+
+  template <typename T, size_t N>
+  static void Generate(T (&state)[N]) {
+#if RANDEN_HEADER_ONLY
+    inl::Generate(inl::Lanes(state));
+#else
+    Internal::Generate(state);
+#endif
+  }
+
+  template <typename T, size_t N>
+  static void Generate2(T (&state0)[N], T (&state1)[N]) {
+#if RANDEN_HEADER_ONLY
+    inl::Generate2(inl::Lanes(state0), inl::Lanes(state1));
+#else
+    Internal::Generate2(state0, state1);
+#endif
+  }
+
+  template <typename T, size_t N>
+  static void GenerateStream(T (&state)[N], void* out,
+                             const size_t num_buffers) {
+#if RANDEN_HEADER_ONLY
+    inl::GenerateStream(inl::Lanes(state), static_cast<uint64_t*>(out),
+                        num_buffers);
+#else
+    Internal::GenerateStream(state, out, num_buffers);
+#endif
+  }
+};
+
+// Buffer geometry: each refill applies "Sponge" kBuffers times in a row and
+// keeps all their outputs, so Randen refills kBuffers times less often. The
+// output sequence is the same as with "Sponge" (except after reseed, which
+// discards the rest of the larger buffer), but costs kBuffers - 1 additional
+// copies of the rate per refill, and the engine is larger.
+// Buffer layout: the capacity, then the rate of each application; the
+// capacity and last rate are the state of "Sponge".
+template <int kBuffers, class Sponge = RandenSponge>
+struct ChainedSponge {
+  static_assert(kBuffers >= 1, "Need at least one buffer");
+  static_assert(Sponge::kBufferBytes == Internal::kStateBytes,
+                "Sponge must not already be chained");
+
+  static constexpr int kRateBytes =
+      Internal::kStateBytes - Internal::kCapacityBytes;
+  static constexpr int kBufferBytes =
+      Internal::kCapacityBytes + kBuffers * kRateBytes;
+
+  template <typename T, size_t N>
+  static void Absorb(const void* seed, T (&buffer)[N]) {
+    alignas(32) T state[Internal::kStateBytes / sizeof(T)];
+    Load(buffer, state);
+    Sponge::Absorb(seed, state);
+    Store(state, buffer);
+  }
+
+  template <typename T, size_t N>
+  static void Generate(T (&buffer)[N]) {
+    alignas(32) T state[Internal::kStateBytes / sizeof(T)];
+    Load(buffer, state);
+    uint8_t* rate =
+        reinterpret_cast<uint8_t*>(buffer) + Internal::kCapacityBytes;
+    const uint8_t* state_rate =
+        reinterpret_cast<const uint8_t*>(state) + Internal::kCapacityBytes;
+    for (int i = 0; i < kBuffers - 1; ++i) {
+      Sponge::Generate(state);
+      memcpy(rate + i * kRateBytes, state_rate, kRateBytes);
+    }
+    Sponge::Generate(state);
+    Store(state, buffer);
+  }
+
+  template <typename T, size_t N>
+  static void Generate2(T (&buffer0)[N], T (&buffer1)[N]) {
+    Generate(buffer0);
+    Generate(buffer1);
+  }
+
+  template <typename T, size_t N>
+  static void GenerateStream(T (&buffer)[N], void* out,
+                             const size_t num_buffers) {
+    alignas(32) T state[Internal::kStateBytes / sizeof(T)];
+    Load(buffer, state);
+    Sponge::GenerateStream(state, out, num_buffers);
+    Store(state, buffer);
+  }
+
+ private:
+  template <typename T, size_t N, size_t S>
+  static void Load(const T (&buffer)[N], T (&state)[S]) {
+    static_assert(sizeof(buffer) == kBufferBytes, "Size mismatch");
+    memcpy(state, buffer, Internal::kCapacityBytes);
+    memcpy(reinterpret_cast<uint8_t*>(state) + Internal::kCapacityBytes,
+           reinterpret_cast<const uint8_t*>(buffer) + sizeof(buffer) -
+               kRateBytes,
+           kRateBytes);
+  }
+
+  template <typename T, size_t S, size_t N>
+  static void Store(const T (&state)[S], T (&buffer)[N]) {
+    memcpy(buffer, state, Internal::kCapacityBytes);
+    memcpy(reinterpret_cast<uint8_t*>(buffer) + sizeof(buffer) - kRateBytes,
+           reinterpret_cast<const uint8_t*>(state) + Internal::kCapacityBytes,
+           kRateBytes);
+  }
 };
 
 // Deterministic pseudorandom byte generator with backtracking resistance
@@ -48,7 +320,9 @@ struct Internal {
 // (see "A Robust and Sponge-Like PRNG with Improved Efficiency") instantiated
 // with an improved Simpira-like permutation.
 // Returns values of type "T" (must be a built-in unsigned integer type).
-template <typename T>
+// "Sponge" determines the permutation (RandenSponge unless RandenSim, see
+// randen_sim.h) and the buffer size (e.g. ChainedSponge).
+template <typename T, class Sponge = RandenSponge>
 class alignas(32) Randen {
   static_assert(std::is_unsigned<T>::value,
                 "Randen must be parameterized by a built-in unsigned integer");
@@ -81,6 +355,10 @@ class alignas(32) Randen {
   Randen(Randen&&) = default;
   Randen& operator=(Randen&&) = default;
 
+#if RANDEN_STATS
+  ~Randen() { CountServed(); }
+#endif
+
   // Returns random bits from the buffer in units of T.
   result_type operator()() {
     // (Local copy ensures compiler knows this is not aliased.)
@@ -88,8 +366,10 @@ class alignas(32) Randen {
 
     // Refill the buffer if needed (unlikely).
     if (next >= kStateT) {
-      Internal::Generate(state_);
+      CountServed();
+      Refill();
       next = kCapacityT;
+      ResetServed(next);
     }
 
     const result_type ret = state_[next];
@@ -97,6 +377,118 @@ class alignas(32) Randen {
     return ret;
   }
 
+  // Writes "size" bytes: the native representation of the next
+  // ceil(size / sizeof(T)) values that operator() would have returned.
+  void Fill(void* bytes, size_t size) {
+    uint8_t* out = static_cast<uint8_t*>(bytes);
+    while (size != 0) {
+      if (next_ >= kStateT) {
+        CountServed();
+        Refill();
+        next_ = kCapacityT;
+        ResetServed(next_);
+      }
+      const size_t copy = std::min((kStateT - next_) * sizeof(T), size);
+      memcpy(out, state_ + next_, copy);
+      next_ += (copy + sizeof(T) - 1) / sizeof(T);
+      out += copy;
+      size -= copy;
+    }
+  }
+
+  // Same result as Fill, but writes whole buffers with non-temporal stores,
+  // which avoids evicting other data from the caches. Only worthwhile for
+  // destinations much larger than the last-level cache. Equivalent to Fill if
+  // the remainder of the current buffer does not end at a multiple of 8
+  // bytes (e.g. unaligned "bytes"). Returns the number of bytes written with
+  // non-temporal stores.
+  size_t FillStream(void* bytes, size_t size) {
+    // Head: finish the current buffer.
+    uint8_t* out = static_cast<uint8_t*>(bytes);
+    const size_t head = std::min((kStateT - next_) * sizeof(T), size);
+    Fill(out, head);
+    out += head;
+    size -= head;
+
+    constexpr size_t kRateBytes =
+        Internal::kStateBytes - Internal::kCapacityBytes;
+    const size_t num_buffers = size / kRateBytes;
+    const size_t streamed = (reinterpret_cast<uintptr_t>(out) % 8 == 0)
+                                ? num_buffers * kRateBytes
+                                : 0;
+    if (streamed != 0) {
+      CountServed();
+      RefillStream(out, num_buffers);
+#if RANDEN_STATS
+      Internal::CountServed(num_buffers * kRateBytes);
+#endif
+      next_ = kStateT;
+      ResetServed(next_);
+      out += streamed;
+      size -= streamed;
+    }
+
+    Fill(out, size);  // tail
+    return streamed;
+  }
+
+  // Returns an independent engine for the path "keys" (StreamKey, e.g.
+  // ForStream(master, "user", user_id)), which is reproducible regardless of
+  // the order in which streams are derived. The result depends on the state of
+  // "master" but not on how many values it returned from its current buffer;
+  // ForStream(ForStream(master, a), b) equals ForStream(master, a, b). Costs
+  // one refill per key of up to 232 bytes (one permutation, or N for
+  // ChainedSponge<N>) and does not modify "master".
+  template <class... Keys>
+  static Randen ForStream(const Randen& master, const Keys&... keys) {
+    static_assert(sizeof...(Keys) != 0, "Need at least one key");
+    const StreamKey path[sizeof...(Keys)] = {StreamKey(keys)...};
+    Randen stream(master);
+    for (const StreamKey& key : path) {
+      stream.AbsorbKey(key);
+    }
+    stream.next_ = kCapacityT;
+    stream.ResetServed(stream.next_);
+    return stream;
+  }
+
+  // Sets streams[i] = ForStream(parent, keys[i]) for all i < "count". Permutes
+  // two states at a time, which is faster if compiled with -mvaes.
+  template <typename Key>
+  static void ForStreams(const Randen& parent, const Key* keys,
+                         const size_t count, Randen* streams) {
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+      const StreamKey key0(keys[i]);
+      const StreamKey key1(keys[i + 1]);
+      Randen& stream0 = streams[i];
+      Randen& stream1 = streams[i + 1];
+      // Counts the values served by the engines being replaced.
+      stream0.CountServed();
+      stream1.CountServed();
+      stream0 = parent;
+      stream1 = parent;
+      if (key0.NumBlocks() == 1 && key1.NumBlocks() == 1) {
+        alignas(32) uint8_t block[StreamKey::kBlockBytes];
+        key0.EncodeBlock(0, block);
+        stream0.Absorb(block);
+        key1.EncodeBlock(0, block);
+        stream1.Absorb(block);
+        Sponge::Generate2(stream0.state_, stream1.state_);
+      } else {
+        stream0.AbsorbKey(key0);
+        stream1.AbsorbKey(key1);
+      }
+      stream0.next_ = stream1.next_ = kCapacityT;
+      stream0.ResetServed(kCapacityT);
+      stream1.ResetServed(kCapacityT);
+    }
+    if (i != count) {
+      streams[i].CountServed();
+      streams[i] = ForStream(parent, keys[i]);
+    }
+  }
+
   template <class SeedSequence>
   typename std::enable_if<
       !std::is_convertible<SeedSequence, result_type>::value, void>::type
@@ -106,7 +498,9 @@ class alignas(32) Randen {
   }
 
   void seed(result_type seed_value = 0) {
+    CountServed();
     next_ = kStateT;
+    ResetServed(next_);
     std::fill(std::begin(state_), std::begin(state_) + kCapacityT, 0);
     std::fill(std::begin(state_) + kCapacityT, std::end(state_), seed_value);
   }
@@ -121,30 +515,41 @@ class alignas(32) Randen {
         (Internal::kStateBytes - Internal::kCapacityBytes) / sizeof(U32);
     U32 buffer[kRate32];
     seq.generate(buffer, buffer + kRate32);
-    Internal::Absorb(buffer, state_);
+    CountServed();
+#if RANDEN_STATS
+    Internal::CountReseed();
+#endif
+    Absorb(buffer);
     next_ = kStateT;  // Generate will be called by operator()
+    ResetServed(next_);
   }
 
   void discard(unsigned long long count) {
+    CountServed();
+#if RANDEN_STATS
+    Internal::CountDiscard();
+#endif
     using ull_t = unsigned long long;
     const ull_t remaining = kStateT - next_;
     if (count <= remaining) {
       next_ += count;
+      ResetServed(next_);
       return;
     }
     count -= remaining;
 
     const ull_t kRateT = kStateT - kCapacityT;
     while (count > kRateT) {
-      Internal::Generate(state_);
+      Refill();
       next_ = kCapacityT;
       count -= kRateT;
     }
 
     if (count != 0) {
-      Internal::Generate(state_);
+      Refill();
       next_ = kCapacityT + count;
     }
+    ResetServed(next_);
   }
 
   bool operator==(const Randen& other) const {
@@ -158,7 +563,7 @@ class alignas(32) Randen {
   template <class CharT, class Traits>
   friend std::basic_ostream<CharT, Traits>& operator<<(
       std::basic_ostream<CharT, Traits>& os,  // NOLINT(runtime/references)
-      const Randen<T>& engine) {              // NOLINT(runtime/references)
+      const Randen& engine) {                 // NOLINT(runtime/references)
     const auto flags = os.flags(std::ios_base::dec | std::ios_base::left);
     const auto fill = os.fill(os.widen(' '));
 
@@ -175,7 +580,7 @@ class alignas(32) Randen {
   template <class CharT, class Traits>
   friend std::basic_istream<CharT, Traits>& operator>>(
       std::basic_istream<CharT, Traits>& is,  // NOLINT(runtime/references)
-      Randen<T>& engine) {                    // NOLINT(runtime/references)
+      Randen& engine) {                       // NOLINT(runtime/references)
     const auto flags = is.flags(std::ios_base::dec | std::ios_base::skipws);
     const auto fill = is.fill(is.widen(' '));
 
@@ -186,8 +591,10 @@ class alignas(32) Randen {
     }
     is >> next;
     if (!is.fail()) {
+      engine.CountServed();
       memcpy(engine.state_, state, sizeof(engine.state_));
       engine.next_ = next;
+      engine.ResetServed(engine.next_);
     }
     is.flags(flags);
     is.fill(fill);
@@ -195,14 +602,53 @@ class alignas(32) Randen {
   }
 
  private:
-  static constexpr size_t kStateT = Internal::kStateBytes / sizeof(T);
+  static constexpr size_t kStateT = Sponge::kBufferBytes / sizeof(T);
   static constexpr size_t kCapacityT = Internal::kCapacityBytes / sizeof(T);
 
+  void Absorb(const void* seed) { Sponge::Absorb(seed, state_); }
+  void Refill() { Sponge::Generate(state_); }
+
+  // Absorbs each block of "key" and permutes after each (see ForStream).
+  void AbsorbKey(const StreamKey& key) {
+    alignas(32) uint8_t block[StreamKey::kBlockBytes];
+    for (size_t i = 0; i < key.NumBlocks(); ++i) {
+      key.EncodeBlock(i, block);
+      Absorb(block);
+      Refill();
+    }
+  }
+  void RefillStream(void* out, const size_t num_buffers) {
+    Sponge::GenerateStream(state_, out, num_buffers);
+  }
+
+  // Statistics: counts the values returned since the previous ResetServed.
+  void CountServed() const {
+#if RANDEN_STATS
+    Internal::CountServed((next_ - served_begin_) * sizeof(T));
+#endif
+  }
+
+  // Statistics: subsequent values starting at state_[next] are uncounted.
+  void ResetServed(const size_t next) {
+#if RANDEN_STATS
+    served_begin_ = next;
+#endif
+  }
+
   // First kCapacityT are `inner', the others are accessible random bits.
   alignas(32) result_type state_[kStateT];
-  size_t next_;  // index within state_
+  size_t next_ = kStateT;  // index within state_
+#if RANDEN_STATS
+  size_t served_begin_ = kStateT;  // index of the first uncounted value
+#endif
 };
 
+#if RANDEN_HEADER_ONLY
+}  // namespace header_only
+#elif RANDEN_STATS
+}  // namespace stats
+#endif
+
 }  // namespace randen
 
 #endif  // RANDEN_H_
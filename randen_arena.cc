@@ -0,0 +1,81 @@
+// Copyright 2018 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "randen_arena.h"
+
+#include <stdlib.h>
+#include <string.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+#include <algorithm>
+#include <limits>
+#include <new>
+
+namespace randen {
+
+RandenArena::~RandenArena() {
+  for (uint64_t* block : blocks_) {
+    free(block);
+  }
+}
+
+RandenArena::Handle RandenArena::Create(const uint64_t seed_value) {
+  const size_t index = next_.size();
+  // Handles would otherwise alias existing engines.
+  if (index > std::numeric_limits<Handle>::max()) {
+    throw std::bad_alloc();
+  }
+  if ((index >> kLog2StatesPerBlock) == blocks_.size()) {
+    void* block;
+    if (posix_memalign(&block, kBlockBytes, kBlockBytes) != 0) {
+      throw std::bad_alloc();
+    }
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    madvise(block, kBlockBytes, MADV_HUGEPAGE);  // only a hint
+#endif
+    blocks_.push_back(static_cast<uint64_t*>(block));
+  }
+  next_.push_back(static_cast<uint8_t>(kStateLanes));
+
+  // As Randen::seed.
+  const Handle handle = static_cast<Handle>(index);
+  uint64_t* state = State(handle);
+  std::fill(state, state + kCapacityLanes, 0);
+  std::fill(state + kCapacityLanes, state + kStateLanes, seed_value);
+  return handle;
+}
+
+size_t RandenArena::RefillDepleted() {
+  size_t num_refills = 0;
+  uint64_t* pending = nullptr;  // depleted; awaiting a second state
+  for (size_t i = 0; i < next_.size(); ++i) {
+    if (next_[i] < kStateLanes) continue;
+    next_[i] = kCapacityLanes;
+    ++num_refills;
+    uint64_t* state = State(static_cast<Handle>(i));
+    if (pending == nullptr) {
+      pending = state;
+    } else {
+      Internal::Generate2(pending, state);
+      pending = nullptr;
+    }
+  }
+  if (pending != nullptr) {
+    Internal::Generate(pending);
+  }
+  return num_refills;
+}
+
+}  // namespace randen
@@ -0,0 +1,110 @@
+// Copyright 2018 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Storage for millions of Randen<uint64_t> engines (e.g. one per user).
+
+#ifndef RANDEN_ARENA_H_
+#define RANDEN_ARENA_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "randen.h"
+
+namespace randen {
+
+// Engines whose states are contiguous in 2 MiB blocks (transparent huge pages
+// on Linux, which reduces TLB misses) and whose positions are in a separate
+// byte array. Each engine costs 257 bytes plus the caller's 4-byte Handle, vs.
+// 288 for Randen<uint64_t>. Engines created with the same seed return the
+// same values as Randen<uint64_t>.
+//
+// Thread-compatible: concurrent calls for different handles are safe, except
+// Create and RefillDepleted, which require exclusive access.
+class RandenArena {
+ public:
+  // Index of an engine; valid until the arena is destroyed.
+  using Handle = uint32_t;
+
+  RandenArena() = default;
+  ~RandenArena();
+
+  RandenArena(const RandenArena&) = delete;
+  RandenArena& operator=(const RandenArena&) = delete;
+
+  // Same as Randen<uint64_t>(seed_value). Throws std::bad_alloc if memory or
+  // handles (2^32) are exhausted.
+  Handle Create(uint64_t seed_value = 0);
+
+  // Same as Randen<uint64_t>(seq).
+  template <class SeedSequence>
+  Handle Create(SeedSequence& seq) {
+    const Handle handle = Create();
+    using U32 = typename SeedSequence::result_type;
+    constexpr int kRate32 = kRateBytes / sizeof(U32);
+    alignas(32) U32 buffer[kRate32];
+    seq.generate(buffer, buffer + kRate32);
+    Internal::Absorb(buffer, State(handle));
+    return handle;
+  }
+
+  size_t size() const { return next_.size(); }
+
+  // Bytes allocated for all engines (excluding the callers' handles).
+  size_t MemoryBytes() const {
+    return blocks_.size() * kBlockBytes + next_.capacity() * sizeof(next_[0]);
+  }
+
+  // Returns the next value of the engine, as Randen<uint64_t>::operator().
+  uint64_t operator()(const Handle handle) {
+    size_t next = next_[handle];
+    uint64_t* state = State(handle);
+    if (next >= kStateLanes) {
+      Internal::Generate(state);
+      next = kCapacityLanes;
+    }
+    next_[handle] = static_cast<uint8_t>(next + 1);
+    return state[next];
+  }
+
+  // Refills all engines whose buffer is exhausted (which operator() would
+  // otherwise do on their next call), two states at a time in handle order.
+  // Worthwhile before accessing most engines, e.g. once per simulation step.
+  // Returns the number of refills.
+  size_t RefillDepleted();
+
+ private:
+  static constexpr size_t kBlockBytes = size_t(2) << 20;
+  static constexpr size_t kStateLanes = Internal::kStateBytes / 8;
+  static constexpr size_t kCapacityLanes = Internal::kCapacityBytes / 8;
+  static constexpr size_t kRateBytes =
+      Internal::kStateBytes - Internal::kCapacityBytes;
+  static constexpr int kLog2StatesPerBlock = 13;
+  static_assert((size_t(1) << kLog2StatesPerBlock) * Internal::kStateBytes ==
+                    kBlockBytes,
+                "Block size mismatch");
+
+  uint64_t* State(const Handle handle) const {
+    const size_t slot = handle & ((1u << kLog2StatesPerBlock) - 1);
+    return blocks_[handle >> kLog2StatesPerBlock] + slot * kStateLanes;
+  }
+
+  std::vector<uint64_t*> blocks_;  // owned, each kBlockBytes
+  std::vector<uint8_t> next_;      // per engine, as Randen::next_
+};
+
+}  // namespace randen
+
+#endif  // RANDEN_ARENA_H_
@@ -0,0 +1,118 @@
+// Copyright 2018 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Compares RandenArena with std::vector<Randen<uint64_t>>: memory per engine
+// and the time for drawing one buffer (30 values, i.e. one refill) from every
+// engine, in handle order or shuffled. Usage: randen_arena_benchmark [engines]
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <numeric>  // iota
+#include <random>
+#include <vector>
+
+#include "nanobenchmark.h"
+#include "randen_arena.h"
+#include "timer.h"
+
+namespace randen {
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using EngRanden = Randen<uint64_t>;
+
+constexpr int kValuesPerBuffer = 30;
+
+// Returns the minimum duration [ns] of "func" divided by "count".
+double NanosecondsPer(const size_t count,
+                      const std::function<uint64_t()>& func) {
+  double min_seconds = 1E30;
+  for (int rep = 0; rep < 3; ++rep) {
+    const Clock::time_point begin = Clock::now();
+    uint64_t sum = func();
+    const Clock::time_point end = Clock::now();
+    PreventElision(sum);
+    min_seconds = std::min(
+        min_seconds, std::chrono::duration<double>(end - begin).count());
+  }
+  return min_seconds * 1E9 / count;
+}
+
+void Run(const size_t num_engines) {
+  RandenArena arena;
+  std::vector<EngRanden> engines;
+  engines.reserve(num_engines);
+  for (size_t i = 0; i < num_engines; ++i) {
+    arena.Create(i);
+    engines.emplace_back(i);
+  }
+
+  std::vector<RandenArena::Handle> order(num_engines);
+  std::iota(order.begin(), order.end(), 0);
+  printf("%zu engines; bytes per engine: vector %zu, arena %.1f + %zu handle\n",
+         num_engines, sizeof(EngRanden),
+         static_cast<double>(arena.MemoryBytes()) / num_engines,
+         sizeof(RandenArena::Handle));
+  printf("%-10s %9s %9s %14s  (ns per engine and buffer)\n", "Order",
+         "vector", "arena", "RefillDepleted");
+
+  for (const bool shuffled : {false, true}) {
+    if (shuffled) {
+      std::shuffle(order.begin(), order.end(), std::mt19937(123));
+    }
+    const double vector_ns = NanosecondsPer(num_engines, [&]() {
+      uint64_t sum = 0;
+      for (const RandenArena::Handle i : order) {
+        EngRanden& engine = engines[i];
+        for (int j = 0; j < kValuesPerBuffer; ++j) {
+          sum += engine();
+        }
+      }
+      return sum;
+    });
+
+    double refill_seconds = 0.0;
+    const double arena_ns = NanosecondsPer(num_engines, [&]() {
+      const Clock::time_point begin = Clock::now();
+      arena.RefillDepleted();
+      refill_seconds = std::chrono::duration<double>(Clock::now() - begin)
+                           .count();
+      uint64_t sum = 0;
+      for (const RandenArena::Handle handle : order) {
+        for (int j = 0; j < kValuesPerBuffer; ++j) {
+          sum += arena(handle);
+        }
+      }
+      return sum;
+    });
+    printf("%-10s %9.1f %9.1f %14.1f\n", shuffled ? "shuffled" : "sequential",
+           vector_ns, arena_ns, refill_seconds * 1E9 / num_engines);
+  }
+}
+
+}  // namespace
+}  // namespace randen
+
+int main(int argc, char* argv[]) {
+  const size_t num_engines =
+      (argc > 1) ? strtoull(argv[1], nullptr, 10) : size_t(1) << 20;
+  // Avoid migrating between cores - important on multi-socket systems.
+  randen::platform::PinThreadToCPU();
+  randen::Run(num_engines);
+  return 0;
+}
@@ -0,0 +1,111 @@
+// Copyright 2018 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "randen_arena.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <random>  // seed_seq
+#include <vector>
+
+namespace randen {
+namespace {
+
+#define STR(x) #x
+
+#define ASSERT_TRUE(condition)                                                \
+  do {                                                                        \
+    if (!(condition)) {                                                       \
+      printf("Assertion [" STR(condition) "] failed on line %d\n", __LINE__); \
+      abort();                                                                \
+    }                                                                         \
+  } while (false)
+
+using EngRanden = Randen<uint64_t>;
+
+// Spans more than one block of states.
+constexpr size_t kNumEngines = 8192 + 3;
+
+// Engines return the same values as Randen, regardless of the order of calls.
+void VerifySameAsRanden() {
+  RandenArena arena;
+  std::vector<EngRanden> engines;
+  std::vector<RandenArena::Handle> handles;
+  for (size_t i = 0; i < kNumEngines; ++i) {
+    handles.push_back(arena.Create(i));
+    engines.emplace_back(i);
+  }
+  std::seed_seq seq{1, 2, 3};
+  handles.push_back(arena.Create(seq));
+  engines.emplace_back(seq);
+  ASSERT_TRUE(arena.size() == kNumEngines + 1);
+
+  for (size_t rep = 0; rep < 40; ++rep) {
+    for (size_t i = 0; i < handles.size(); i += 1 + (i + rep) % 5) {
+      ASSERT_TRUE(arena(handles[i]) == engines[i]());
+    }
+  }
+}
+
+// Full blocks require less memory than Randen.
+void VerifyMemory() {
+  RandenArena arena;
+  for (size_t i = 0; i < 2 * 8192; ++i) {
+    arena.Create();
+  }
+  ASSERT_TRUE(arena.MemoryBytes() / arena.size() < sizeof(EngRanden));
+}
+
+// RefillDepleted does not change the values returned.
+void VerifyRefillDepleted() {
+  RandenArena arena;
+  std::vector<EngRanden> engines;
+  for (size_t i = 0; i < kNumEngines; ++i) {
+    arena.Create(i);
+    engines.emplace_back(i);
+  }
+  // All are initially depleted.
+  ASSERT_TRUE(arena.RefillDepleted() == kNumEngines);
+  ASSERT_TRUE(arena.RefillDepleted() == 0);
+
+  // Exhaust the buffer of every third engine (30 values per buffer).
+  size_t num_depleted = 0;
+  for (size_t i = 0; i < kNumEngines; i += 3) {
+    for (int j = 0; j < 30; ++j) {
+      ASSERT_TRUE(arena(i) == engines[i]());
+    }
+    ++num_depleted;
+  }
+  ASSERT_TRUE(arena.RefillDepleted() == num_depleted);
+
+  for (size_t i = 0; i < kNumEngines; ++i) {
+    for (int j = 0; j < 31; ++j) {
+      ASSERT_TRUE(arena(i) == engines[i]());
+    }
+  }
+}
+
+void RunAll() {
+  VerifySameAsRanden();
+  VerifyRefillDepleted();
+  VerifyMemory();
+}
+
+}  // namespace
+}  // namespace randen
+
+int main(int argc, char* argv[]) {
+  randen::RunAll();
+  return 0;
+}
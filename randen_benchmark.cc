@@ -12,60 +12,45 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
-// Please disable Turbo Boost and CPU throttling!
+// Please disable Turbo Boost and CPU throttling! (Or use --perf, which also
+// reports core cycles.)
 
 #include "randen.h"
 
-// std::uniform_*_distribution are slow due to division/log2; we provide
-// faster variants if this is 0.
-#define USE_STD_DISTRIBUTIONS 0
-
-// Which engines to benchmark.
-#define ENABLE_RANDEN 1
-#define ENABLE_PCG 1
-#define ENABLE_MT 1
-#if defined(__SSE2__) && defined(__AES__)
-#define ENABLE_CHACHA 1
-#else
-#define ENABLE_CHACHA 0
-#endif
-#define ENABLE_OS 1
-
-#if ENABLE_PCG
-#include "third_party/pcg_random/include/pcg_random.hpp"
-#endif
-
-#if ENABLE_MT
-#include <random>
-#endif
-
-#if ENABLE_CHACHA
-#include "engine_chacha.h"
+// Recorded in --json/--csv output; the Makefile passes CXXFLAGS.
+#ifndef RANDEN_COMPILE_FLAGS
+#define RANDEN_COMPILE_FLAGS ""
 #endif
 
-#if ENABLE_OS
-#include "engine_os.h"
-#endif
-
-
 #ifdef _MSC_VER
 #include <intrin.h>
 #endif
+#include <ctype.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
 #include <numeric>  // iota
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
 
+#include "benchmark_report.h"
+#include "engine_registry.h"
 #include "nanobenchmark.h"
+#include "timer.h"
 #include "util.h"
+#include "vector128.h"
 
 namespace randen {
 namespace {
 
-#if USE_STD_DISTRIBUTIONS
-using UniformInt = std::uniform_int_distribution<int>;
-using UniformDouble = std::uniform_real_distribution<double>;
-#else
-// These are subsets of std::uniform_*_distribution.
+// std::uniform_*_distribution are slow due to division/log2; we provide
+// faster variants, which are subsets of std::uniform_*_distribution.
 
 class UniformInt {
  public:
@@ -159,14 +144,33 @@ class UniformDouble {
     return ret;
   }
 };
-#endif  // !USE_STD_DISTRIBUTIONS
+
+// Distributions used by the benchmarks; --std-dists selects the standard ones.
+struct FastDistributions {
+  static constexpr bool kStd = false;
+  static const char* Suffix() { return ""; }
+  using Int = UniformInt;
+  using Double = UniformDouble;
+};
+
+struct StdDistributions {
+  static constexpr bool kStd = true;
+  // Distinguishes their BenchmarkRecord from the default distributions'.
+  static const char* Suffix() { return "(std)"; }
+  using Int = std::uniform_int_distribution<int>;
+  using Double = std::uniform_real_distribution<double>;
+};
 
 // Benchmark::Num64() is passed to its constructor and operator() after
 // multiplying with a (non-compile-time-constant) 1 to prevent constant folding.
-// It is also used to compute cycles per byte.
+// It is also used to compute cycles per byte. RecordName() identifies the
+// benchmark and its distributions in BenchmarkRecord.
 
 // Microbenchmark: generates N numbers in a tight loop.
 struct BenchmarkLoop {
+  static const char* Name() { return "Loop"; }
+  static std::string RecordName() { return Name(); }
+
   // Large enough that we can ignore size % buffer size.
   static size_t Num64() { return 100000; }
 
@@ -182,8 +186,13 @@ struct BenchmarkLoop {
 };
 
 // Real-world benchmark: shuffles a vector.
+template <class Dists>
 class BenchmarkShuffle {
  public:
+  static const char* Name() { return "Shuffle"; }
+  static std::string RecordName() {
+    return std::string(Name()) + Dists::Suffix();
+  }
   static size_t Num64() { return 50000; }
 
   explicit BenchmarkShuffle(const uint64_t num_64) : ints_to_shuffle_(num_64) {}
@@ -191,16 +200,18 @@ class BenchmarkShuffle {
   template <class Engine>
   uint64_t operator()(const uint64_t num_64, Engine& engine) const {
     ints_to_shuffle_[0] = static_cast<int>(num_64 & 0xFFFF);
-#if USE_STD_DISTRIBUTIONS
-    std::shuffle(ints_to_shuffle_.begin(), ints_to_shuffle_.end(), engine);
-#else
-    // Similar algorithm, but UniformInt instead of std::u_i_d => 2-3x speedup.
-    UniformInt dist;
-    for (size_t i = num_64 - 1; i != 0; --i) {
-      const UniformInt::param_type param(0, i);
-      std::swap(ints_to_shuffle_[i], ints_to_shuffle_[dist(engine, param)]);
+    if (Dists::kStd) {
+      std::shuffle(ints_to_shuffle_.begin(), ints_to_shuffle_.begin() + num_64,
+                   engine);
+    } else {
+      // Similar algorithm, but UniformInt instead of std::u_i_d => 2-3x
+      // speedup.
+      typename Dists::Int dist;
+      for (size_t i = num_64 - 1; i != 0; --i) {
+        const typename Dists::Int::param_type param(0, i);
+        std::swap(ints_to_shuffle_[i], ints_to_shuffle_[dist(engine, param)]);
+      }
     }
-#endif
     return ints_to_shuffle_[0];
   }
 
@@ -209,25 +220,31 @@ class BenchmarkShuffle {
 };
 
 // Reservoir sampling.
+template <class Dists>
 class BenchmarkSample {
  public:
+  static const char* Name() { return "Sample"; }
+  static std::string RecordName() {
+    return std::string(Name()) + Dists::Suffix();
+  }
   static size_t Num64() { return 50000; }
 
   explicit BenchmarkSample(const uint64_t num_64)
-      : population_(num_64), chosen_(kNumChosen) {
+      : population_(num_64), chosen_(NumChosen(num_64)) {
     std::iota(population_.begin(), population_.end(), 0);
   }
 
   template <class Engine>
   uint64_t operator()(const uint64_t num_64, Engine& engine) const {
+    const size_t num_chosen = NumChosen(num_64);
     // Can replace with std::sample after C++17.
-    std::copy(population_.begin(), population_.begin() + kNumChosen,
+    std::copy(population_.begin(), population_.begin() + num_chosen,
               chosen_.begin());
-    UniformInt dist;
-    for (size_t i = kNumChosen; i < num_64; ++i) {
-      const UniformInt::param_type param(0, i);
+    typename Dists::Int dist;
+    for (size_t i = num_chosen; i < num_64; ++i) {
+      const typename Dists::Int::param_type param(0, i);
       const size_t index = dist(engine, param);
-      if (index < kNumChosen) {
+      if (index < num_chosen) {
         chosen_[index] = population_[i];
       }
     }
@@ -236,15 +253,24 @@ class BenchmarkSample {
   }
 
  private:
-  static constexpr size_t kNumChosen = 10000;
+  // A fixed fraction, so that the number of random draws (80% of num_64)
+  // scales with the population, also for the smaller sizes of --sweep.
+  static size_t NumChosen(const uint64_t num_64) {
+    return std::max<size_t>(1, num_64 / 5);
+  }
 
   std::vector<int> population_;
   mutable std::vector<int> chosen_;
 };
 
 // Actual application: Monte Carlo estimation of Pi * 1E6.
+template <class Dists>
 class BenchmarkMonteCarlo {
  public:
+  static const char* Name() { return "MonteCarlo"; }
+  static std::string RecordName() {
+    return std::string(Name()) + Dists::Suffix();
+  }
   static size_t Num64() { return 200000; }
 
   explicit BenchmarkMonteCarlo(const uint64_t num_64) {}
@@ -261,17 +287,34 @@ class BenchmarkMonteCarlo {
   }
 
  private:
-  mutable UniformDouble dist_;
+  mutable typename Dists::Double dist_;
 };
 
+// Measures a single call of "benchmark" with "num_64". Returns false if the
+// measurement failed.
 template <class Benchmark, class Engine>
-void RunBenchmark(const char* caption, Engine& engine, const int unpredictable1,
-                  const Benchmark& benchmark) {
-  printf("%8s: ", caption);
-  const size_t kNumInputs = 1;
-  const FuncInput inputs[kNumInputs] = {
-      static_cast<FuncInput>(Benchmark::Num64() * unpredictable1)};
-  Result results[kNumInputs];
+bool MeasureBenchmark(Engine& engine, const Benchmark& benchmark,
+                      const FuncInput num_64, const Params& p, Result* result) {
+  const FuncInput inputs[1] = {num_64};
+  const size_t num_results = MeasureClosure(
+      [&benchmark, &engine](const FuncInput input) {
+        return benchmark(input, engine);
+      },
+      inputs, 1, result, p);
+  return num_results == 1;
+}
+
+// Computes cycles per byte (and its median absolute deviation) of "benchmark"
+// with its default Num64. If "events" is non-null, also counts hardware events
+// per byte (negative if unavailable). Returns false if the measurement failed,
+// e.g. due to interference from other threads.
+template <class Benchmark, class Engine>
+bool MeasureCyclesPerByte(Engine& engine, const int unpredictable1,
+                          const Benchmark& benchmark, double* cycles_per_byte,
+                          double* mad, PerfCounts* events = nullptr) {
+  const FuncInput num_64 =
+      static_cast<FuncInput>(Benchmark::Num64() * unpredictable1);
+  Result results[1];
 
   Params p;
   p.verbose = false;
@@ -281,86 +324,1073 @@ void RunBenchmark(const char* caption, Engine& engine, const int unpredictable1,
   p.max_evals = 8;
 #endif
   p.target_rel_mad = 0.002;
-  const size_t num_results = MeasureClosure(
-      [&benchmark, &engine](const FuncInput input) {
-        return benchmark(input, engine);
-      },
-      inputs, kNumInputs, results, p);
-  RANDEN_CHECK(num_results == kNumInputs);
-  for (size_t i = 0; i < num_results; ++i) {
-    const double cycles_per_byte =
-        results[i].ticks / (results[i].input * sizeof(uint64_t));
-    const double mad = results[i].variability * cycles_per_byte;
-    printf("%6zu: %5.2f (+/- %5.3f)\n", results[i].input, cycles_per_byte, mad);
+  p.perf_counters = events != nullptr;
+  if (!MeasureBenchmark(engine, benchmark, num_64, p, results)) return false;
+  const double bytes = results[0].input * sizeof(uint64_t);
+  *cycles_per_byte = results[0].ticks / bytes;
+  *mad = results[0].variability * *cycles_per_byte;
+  if (events != nullptr) {
+    *events = results[0].events;
+    for (double* count : {&events->cycles, &events->instructions,
+                          &events->branch_misses, &events->l1d_misses}) {
+      if (*count >= 0.0) *count /= bytes;
+    }
+  }
+  return true;
+}
+
+// Prints core cycles (which, unlike TSC ticks, are affected by turbo) and
+// instructions per cycle; misses are per KiB.
+void PrintEvents(const PerfCounts& events) {
+  if (events.cycles < 0.0 && events.instructions < 0.0) {
+    printf(" [perf counters unavailable]");
+    return;
+  }
+  printf(" [cycles/B %5.2f", events.cycles);
+  if (events.cycles > 0.0 && events.instructions >= 0.0) {
+    printf(" IPC %4.2f", events.instructions / events.cycles);
+  }
+  printf(" branch-misses/KiB %5.2f L1D-misses/KiB %5.2f]",
+         events.branch_misses * 1024, events.l1d_misses * 1024);
+}
+
+// Prints and appends to "records".
+template <class Benchmark, class Engine>
+void RunBenchmark(const char* caption, Engine& engine, const int unpredictable1,
+                  const Benchmark& benchmark, const bool perf_counters,
+                  std::vector<BenchmarkRecord>* records) {
+  printf("%8s: ", caption);
+  BenchmarkRecord record;
+  PerfCounts events;
+  RANDEN_CHECK(MeasureCyclesPerByte(engine, unpredictable1, benchmark,
+                                    &record.cpb, &record.mad,
+                                    perf_counters ? &events : nullptr));
+  record.engine = caption;
+  record.benchmark = Benchmark::RecordName();
+  record.input = Benchmark::Num64() * unpredictable1;
+  printf("%6zu: %5.2f (+/- %5.3f)", record.input, record.cpb, record.mad);
+  if (perf_counters) PrintEvents(events);
+  printf("\n");
+  records->push_back(record);
+}
+
+// Benchmark registry: calls visitor.Visit<Benchmark>() for each selected
+// benchmark. "Dists" are the distributions used by the benchmarks.
+template <class Dists, class Visitor>
+void ForeachBenchmarkWith(const Selection& benchmarks, Visitor& visitor) {
+  if (benchmarks.Contains(BenchmarkLoop::Name())) {
+    visitor.template Visit<BenchmarkLoop>();
+  }
+  if (benchmarks.Contains(BenchmarkShuffle<Dists>::Name())) {
+    visitor.template Visit<BenchmarkShuffle<Dists>>();
+  }
+  if (benchmarks.Contains(BenchmarkSample<Dists>::Name())) {
+    visitor.template Visit<BenchmarkSample<Dists>>();
+  }
+  if (benchmarks.Contains(BenchmarkMonteCarlo<Dists>::Name())) {
+    visitor.template Visit<BenchmarkMonteCarlo<Dists>>();
+  }
+}
+
+template <class Visitor>
+void ForeachBenchmark(const Selection& benchmarks, const bool std_dists,
+                      Visitor& visitor) {
+  if (std_dists) {
+    ForeachBenchmarkWith<StdDistributions>(benchmarks, visitor);
+  } else {
+    ForeachBenchmarkWith<FastDistributions>(benchmarks, visitor);
+  }
+}
+
+// Collects the names of all registered engines and benchmarks.
+class VisitorNames : public EngineVisitor {
+ public:
+  template <class Engine>
+  void Visit(const char* caption) {
+    names.push_back(caption);
+  }
+
+  void Unsupported(const char* caption) { names.push_back(caption); }
+
+  template <class Benchmark>
+  void Visit() {
+    names.push_back(Benchmark::Name());
+  }
+
+  std::vector<std::string> names;
+};
+
+// Single-threaded cycles per byte for each engine.
+template <class Benchmark>
+class VisitorSingle : public EngineVisitor {
+ public:
+  VisitorSingle(const int unpredictable1, const bool perf_counters,
+                std::vector<BenchmarkRecord>* records)
+      : unpredictable1_(unpredictable1),
+        benchmark_(static_cast<uint64_t>(Benchmark::Num64() * unpredictable1)),
+        perf_counters_(perf_counters),
+        records_(records) {}
+
+  template <class Engine>
+  void Visit(const char* caption) {
+    Engine engine;
+    RunBenchmark(caption, engine, unpredictable1_, benchmark_, perf_counters_,
+                 records_);
   }
+
+ private:
+  const int unpredictable1_;
+  const Benchmark benchmark_;
+  const bool perf_counters_;
+  std::vector<BenchmarkRecord>* records_;
+};
+
+// Aggregate throughput of 1..max_threads threads, each pinned to its own CPU
+// and with its own engine and Benchmark instance. Unlike RunBenchmark, this
+// measures wall-clock time because the threads share AES units, caches and
+// memory bandwidth; per-thread cpb is derived from each thread's elapsed time.
+template <class Benchmark>
+class VisitorScaling : public EngineVisitor {
+ public:
+  VisitorScaling(const int unpredictable1, const size_t max_threads)
+      : unpredictable1_(unpredictable1), max_threads_(max_threads) {}
+
+  template <class Engine>
+  void Visit(const char* caption) {
+    printf("%8s: threads   GB/s  cpb/thread  efficiency\n", caption);
+    const size_t reps = Calibrate<Engine>();
+
+    double single_gbps = 0.0;
+    for (size_t num_threads = 1; num_threads <= max_threads_;
+         num_threads = NextThreadCount(num_threads)) {
+      const Stats stats = RunThreads<Engine>(num_threads, reps);
+      if (num_threads == 1) single_gbps = stats.gbps;
+      const double efficiency = stats.gbps / (num_threads * single_gbps);
+      printf("%8s  %7zu %6.2f  %10.2f  %9.1f%%\n", "", num_threads,
+             stats.gbps, stats.median_cpb, efficiency * 100.0);
+    }
+  }
+
+ private:
+  // Wall-clock budget for each thread count.
+  static constexpr double kTargetSeconds = 0.25;
+
+  struct Stats {
+    double gbps;        // aggregate
+    double median_cpb;  // of all threads
+  };
+
+  using Clock = std::chrono::steady_clock;
+
+  static double Seconds(const Clock::time_point begin,
+                        const Clock::time_point end) {
+    return std::chrono::duration<double>(end - begin).count();
+  }
+
+  // Doubles up to max_threads_, which is always included.
+  size_t NextThreadCount(const size_t num_threads) const {
+    if (num_threads == max_threads_) return max_threads_ + 1;
+    return std::min(num_threads * 2, max_threads_);
+  }
+
+  // Returns the number of Benchmark calls per thread that take about
+  // kTargetSeconds on a single thread.
+  template <class Engine>
+  size_t Calibrate() const {
+    const uint64_t num_64 = Benchmark::Num64() * unpredictable1_;
+    const Benchmark benchmark(num_64);
+    Engine engine;
+    uint64_t sink = benchmark(num_64, engine);  // warm up caches
+    const Clock::time_point begin = Clock::now();
+    sink += benchmark(num_64, engine);
+    const double seconds = Seconds(begin, Clock::now());
+    sink_.fetch_add(sink, std::memory_order_relaxed);
+    return std::max<size_t>(1, static_cast<size_t>(kTargetSeconds / seconds));
+  }
+
+  template <class Engine>
+  Stats RunThreads(const size_t num_threads, const size_t reps) {
+    static const double ticks_per_second = platform::InvariantTicksPerSecond();
+    const size_t num_cpus =
+        std::max<size_t>(1, std::thread::hardware_concurrency());
+    const uint64_t num_64 = Benchmark::Num64() * unpredictable1_;
+
+    std::atomic<size_t> num_ready{0};
+    std::vector<Clock::time_point> begin(num_threads);
+    std::vector<Clock::time_point> end(num_threads);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < num_threads; ++i) {
+      threads.emplace_back([&, i]() {
+        platform::PinThreadToCPU(static_cast<int>(i % num_cpus));
+        const Benchmark benchmark(num_64);
+        Engine engine;
+        uint64_t sink = benchmark(num_64, engine);  // warm up caches
+
+        // Start all threads at (nearly) the same time.
+        num_ready.fetch_add(1);
+        while (num_ready.load() != num_threads) {
+          std::this_thread::yield();
+        }
+
+        begin[i] = Clock::now();
+        for (size_t rep = 0; rep < reps; ++rep) {
+          sink += benchmark(num_64, engine);
+        }
+        end[i] = Clock::now();
+        sink_.fetch_add(sink, std::memory_order_relaxed);
+      });
+    }
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+
+    const double bytes_per_thread =
+        static_cast<double>(reps) * num_64 * sizeof(uint64_t);
+    std::vector<double> cpb(num_threads);
+    for (size_t i = 0; i < num_threads; ++i) {
+      cpb[i] = Seconds(begin[i], end[i]) * ticks_per_second / bytes_per_thread;
+    }
+    std::sort(cpb.begin(), cpb.end());
+
+    const double wall_seconds =
+        Seconds(*std::min_element(begin.begin(), begin.end()),
+                *std::max_element(end.begin(), end.end()));
+    Stats stats;
+    stats.gbps = bytes_per_thread * num_threads / wall_seconds * 1E-9;
+    stats.median_cpb = cpb[num_threads / 2];
+    return stats;
+  }
+
+  const int unpredictable1_;
+  const size_t max_threads_;
+  // Prevents elision of the benchmark results.
+  static std::atomic<uint64_t> sink_;
+};
+
+template <class Benchmark>
+std::atomic<uint64_t> VisitorScaling<Benchmark>::sink_{0};
+
+// SMT sibling contention: the engine runs on one logical CPU while its
+// hyperthread sibling (same physical core, hence shared AES units and L1/L2)
+// runs a competing load.
+enum class CompetingLoad { kNone, kAES, kInteger, kMemory };
+
+const char* LoadName(const CompetingLoad load) {
+  switch (load) {
+    case CompetingLoad::kNone:
+      return "none";
+    case CompetingLoad::kAES:
+      return "aes";
+    case CompetingLoad::kInteger:
+      return "int";
+    case CompetingLoad::kMemory:
+      return "mem";
+  }
+  return "?";
+}
+
+// Runs "load" until "stop" is set.
+void RunCompetingLoad(const CompetingLoad load, const std::atomic<bool>* stop) {
+  uint64_t sink = 0;
+  if (load == CompetingLoad::kAES) {
+    // Eight independent chains keep the AES unit(s) busy despite latency.
+    alignas(16) uint64_t lanes[8 * kLanes] = {1, 2, 3, 4, 5, 6, 7, 8};
+    V v[8];
+    for (int i = 0; i < 8; ++i) v[i] = Load(lanes, i);
+    while (!stop->load(std::memory_order_relaxed)) {
+      for (int rep = 0; rep < 1024; ++rep) {
+        for (int i = 0; i < 8; ++i) v[i] = AES(v[i], v[(i + 1) % 8]);
+      }
+    }
+    for (int i = 0; i < 8; ++i) Store(v[i], lanes, i);
+    sink = lanes[0];
+  } else if (load == CompetingLoad::kInteger) {
+    uint64_t a = 1, b = 2, c = 3, d = 4;
+    while (!stop->load(std::memory_order_relaxed)) {
+      for (int rep = 0; rep < 1024; ++rep) {
+        a = a * 0x9E3779B97F4A7C15ull + b;
+        b = (b ^ (c >> 7)) + d;
+        c = c * 0xC2B2AE3D27D4EB4Full + a;
+        d = (d ^ (a << 3)) + c;
+      }
+    }
+    sink = a + b + c + d;
+  } else if (load == CompetingLoad::kMemory) {
+    // Read-modify-write of a buffer much larger than L2/L3.
+    std::vector<uint64_t> buffer(64 * 1024 * 1024 / sizeof(uint64_t), 1);
+    while (!stop->load(std::memory_order_relaxed)) {
+      for (size_t i = 0; i < buffer.size(); i += 8) {  // one per cache line
+        buffer[i] += sink++;
+      }
+    }
+    sink += buffer[0];
+  }
+  static std::atomic<uint64_t> dummy{0};
+  dummy.fetch_add(sink, std::memory_order_relaxed);
+}
+
+// Returns the first CPU that has an SMT sibling (and that sibling) according
+// to sysfs, or false if there are none or the topology is unavailable.
+bool FindSiblingPair(int* cpu, int* sibling) {
+  const unsigned num_cpus = std::thread::hardware_concurrency();
+  for (unsigned i = 0; i < num_cpus; ++i) {
+    char path[128];
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%u/topology/thread_siblings_list", i);
+    FILE* f = fopen(path, "r");
+    if (f == nullptr) continue;
+    // Either "0,32" or "0-1" (or just "0" without SMT).
+    int first, second;
+    char separator;
+    const int num_read = fscanf(f, "%d%c%d", &first, &separator, &second);
+    fclose(f);
+    if (num_read == 3 && (separator == ',' || separator == '-')) {
+      *cpu = first;
+      *sibling = second;
+      return true;
+    }
+  }
+  return false;
 }
 
-// Calls RunBenchmark for each (enabled) engine.
+// Cycles per byte of each engine while the sibling runs each of "loads".
 template <class Benchmark>
-void ForeachEngine(const int unpredictable1) {
-  using T = uint64_t;  // WARNING: keep in sync with MT/PCG.
+class VisitorSmt : public EngineVisitor {
+ public:
+  VisitorSmt(const int unpredictable1, const int sibling,
+             const std::vector<CompetingLoad>& loads)
+      : unpredictable1_(unpredictable1),
+        sibling_(sibling),
+        loads_(loads),
+        benchmark_(static_cast<uint64_t>(Benchmark::Num64() * unpredictable1)) {
+  }
 
-  const Benchmark benchmark(
-      static_cast<uint64_t>(Benchmark::Num64() * unpredictable1));
+  template <class Engine>
+  void Visit(const char* caption) {
+    printf("%8s:", caption);
+    double baseline = 0.0;
+    for (const CompetingLoad load : loads_) {
+      std::atomic<bool> stop{false};
+      std::thread competitor;
+      if (load != CompetingLoad::kNone) {
+        const int sibling = sibling_;
+        competitor = std::thread([load, sibling, &stop]() {
+          platform::PinThreadToCPU(sibling);
+          RunCompetingLoad(load, &stop);
+        });
+      }
 
-#if ENABLE_RANDEN
-  Randen<T> eng_randen;
-  RunBenchmark("Randen", eng_randen, unpredictable1, benchmark);
-#endif
+      Engine engine;
+      double cycles_per_byte, mad;
+      const bool ok = MeasureCyclesPerByte(engine, unpredictable1_, benchmark_,
+                                           &cycles_per_byte, &mad);
+      stop.store(true);
+      if (competitor.joinable()) competitor.join();
 
-#if ENABLE_PCG
-  // Quoting from pcg_random.hpp: "the c variants offer better crypographic
-  // security (just how good the cryptographic security is is an open
-  // question)".
-  pcg64_c32 eng_pcg;
-  RunBenchmark("PCG", eng_pcg, unpredictable1, benchmark);
-#endif
+      if (!ok) {
+        printf("  %s failed", LoadName(load));
+        continue;
+      }
+      if (load == CompetingLoad::kNone) baseline = cycles_per_byte;
+      printf("  %s %5.2f", LoadName(load), cycles_per_byte);
+      if (load != CompetingLoad::kNone && baseline != 0.0) {
+        printf(" (%+4.0f%%)", (cycles_per_byte / baseline - 1.0) * 100.0);
+      }
+    }
+    printf("\n");
+  }
 
-#if ENABLE_MT
-  std::mt19937_64 eng_mt;
-  RunBenchmark("MT", eng_mt, unpredictable1, benchmark);
-#endif
+ private:
+  const int unpredictable1_;
+  const int sibling_;
+  const std::vector<CompetingLoad> loads_;
+  const Benchmark benchmark_;
+};
 
+// Randen, ChaCha and AES-CTR (if selected) under SMT contention; all are AES-
+// or SIMD-bound, unlike the scalar engines.
+void RunSmt(const Selection& engines, const int unpredictable1,
+            const std::vector<CompetingLoad>& loads, int cpu, int sibling) {
+  if (cpu < 0 && !FindSiblingPair(&cpu, &sibling)) {
+    printf("No SMT siblings found; use --smt-cpus=A,B to override.\n");
+    return;
+  }
+  printf("SMT contention: CPU %d, sibling %d, cpb with sibling load:\n", cpu,
+         sibling);
+  platform::PinThreadToCPU(cpu);
 
+  using T = uint64_t;
+  VisitorSmt<BenchmarkLoop> visitor(unpredictable1, sibling, loads);
+  VisitEngine<Randen<T>>(engines, "Randen", true, visitor);
 #if ENABLE_CHACHA
-  ChaCha<T> eng_chacha(0x243f6a8885a308d3ull, 0x243F6A8885A308D3ull);
-  RunBenchmark("ChaCha8", eng_chacha, unpredictable1, benchmark);
+  VisitEngine<ChaChaDefault<T>>(engines, "ChaCha8", true, visitor);
 #endif
+#if ENABLE_AESCTR
+  VisitEngine<AesCtr<T>>(engines, "AES-CTR", true, visitor);
+#endif
+}
+
+// Co-runner for --fill: dependent random reads within a working set that fits
+// in the last-level cache, so its rate drops if the fill evicts the set.
+class CacheSensitiveLoad {
+ public:
+  static constexpr size_t kWorkingSetBytes = size_t(4) << 20;
+  static constexpr size_t kLineWords = 64 / sizeof(uint64_t);
+
+  CacheSensitiveLoad() : next_(kWorkingSetBytes / sizeof(uint64_t)) {
+    // Single random cycle through all cache lines (Sattolo's algorithm).
+    const size_t num_lines = next_.size() / kLineWords;
+    std::vector<uint64_t> order(num_lines);
+    std::iota(order.begin(), order.end(), 0);
+    Randen<uint64_t> engine;
+    for (size_t i = num_lines - 1; i != 0; --i) {
+      std::swap(order[i], order[engine() % i]);
+    }
+    for (size_t i = 0; i < num_lines; ++i) {
+      next_[order[i] * kLineWords] = order[(i + 1) % num_lines] * kLineWords;
+    }
+  }
 
-#if ENABLE_OS
-  EngineOS<T> eng_os;
-  RunBenchmark("OS", eng_os, unpredictable1, benchmark);
+  // Reads until "stop" is set; "reads" is updated periodically.
+  void Run(const std::atomic<bool>* stop, std::atomic<uint64_t>* reads) {
+    uint64_t pos = 0;
+    while (!stop->load(std::memory_order_relaxed)) {
+      for (int rep = 0; rep < 1024; ++rep) {
+        pos = next_[pos];
+      }
+      reads->fetch_add(1024, std::memory_order_relaxed);
+    }
+    PreventElision(pos);
+  }
+
+ private:
+  std::vector<uint64_t> next_;
+};
+
+// --fill: throughput of Randen::Fill and FillStream into a buffer of "bytes",
+// and their effect on a cache-sensitive co-runner on another CPU.
+void RunFill(const size_t bytes, const int cpu) {
+  using Clock = std::chrono::steady_clock;
+  const size_t num_cpus =
+      std::max<size_t>(1, std::thread::hardware_concurrency());
+  const int main_cpu = cpu < 0 ? 0 : cpu;
+  const int other_cpu = static_cast<int>((main_cpu + 1) % num_cpus);
+  platform::PinThreadToCPU(main_cpu);
+
+  // Page-aligned; zero-initialized so the timing excludes page faults.
+  std::vector<uint64_t> buffer((bytes + 4095) / sizeof(uint64_t));
+  uint8_t* begin = reinterpret_cast<uint8_t*>(buffer.data());
+  begin += (4096 - reinterpret_cast<uintptr_t>(begin) % 4096) % 4096;
+
+  // Without a second CPU, the co-runner would only steal time from the fill.
+  const bool co_run = num_cpus > 1;
+  CacheSensitiveLoad load;
+  std::atomic<bool> stop{!co_run};
+  std::atomic<uint64_t> reads{0};
+  std::thread co_runner([&]() {
+    platform::PinThreadToCPU(other_cpu);
+    load.Run(&stop, &reads);
+  });
+
+  // Returns co-runner reads per second during "func" (or a sleep) and sets
+  // "seconds" to the duration of func.
+  const auto reads_per_second = [&reads](const std::function<void()>& func,
+                                         double* seconds) {
+    const uint64_t reads_begin = reads.load();
+    const Clock::time_point time_begin = Clock::now();
+    func();
+    const Clock::time_point time_end = Clock::now();
+    *seconds = std::chrono::duration<double>(time_end - time_begin).count();
+    return (reads.load() - reads_begin) / *seconds;
+  };
+
+  double seconds;
+  const double idle_rate = reads_per_second(
+      []() { std::this_thread::sleep_for(std::chrono::milliseconds(500)); },
+      &seconds);
+  printf("Fill %zu bytes on CPU %d; ", bytes, main_cpu);
+  if (co_run) {
+    printf("co-runner on CPU %d: random reads in %zu KiB, %.1f M/s alone\n",
+           other_cpu, CacheSensitiveLoad::kWorkingSetBytes >> 10,
+           idle_rate * 1E-6);
+  } else {
+    printf("no co-runner (single CPU)\n");
+  }
+
+  Randen<uint64_t> engine;
+  for (const bool streaming : {false, true, false, true}) {
+    const double rate = reads_per_second(
+        [&]() {
+          if (streaming) {
+            engine.FillStream(begin, bytes);
+          } else {
+            engine.Fill(begin, bytes);
+          }
+        },
+        &seconds);
+    printf("%10s: %5.2f GB/s", streaming ? "FillStream" : "Fill",
+           bytes / seconds * 1E-9);
+    if (co_run) {
+      printf("; co-runner %5.1f%% slower", (1.0 - rate / idle_rate) * 100.0);
+    }
+    printf("\n");
+  }
+
+  stop.store(true);
+  co_runner.join();
+}
+
+// --streams: cost of deriving a per-entity engine and drawing its first value,
+// via std::seed_seq or Randen::ForStream(s).
+void RunStreams(const size_t count, const int cpu) {
+  using Clock = std::chrono::steady_clock;
+  using Engine = Randen<uint64_t>;
+  platform::PinThreadToCPU(cpu);
+
+  std::seed_seq master_seq{1, 2, 3};
+  const Engine master(master_seq);
+  std::vector<uint64_t> ids(count);
+  std::iota(ids.begin(), ids.end(), 0);
+  std::vector<Engine> streams(count);
+
+  const auto print = [count](const char* caption,
+                             const std::function<uint64_t()>& func) {
+    const Clock::time_point begin = Clock::now();
+    uint64_t sum = func();
+    const Clock::time_point end = Clock::now();
+    const double seconds = std::chrono::duration<double>(end - begin).count();
+    printf("%-30s %7.1f ns per stream\n", caption, seconds * 1E9 / count);
+    PreventElision(sum);
+  };
+
+  printf("Deriving %zu streams and drawing one value from each:\n", count);
+  print("seed_seq{1, 2, 3, id}", [&ids]() {
+    uint64_t sum = 0;
+    for (const uint64_t id : ids) {
+      std::seed_seq seq{uint64_t{1}, uint64_t{2}, uint64_t{3}, id};
+      Engine stream(seq);
+      sum += stream();
+    }
+    return sum;
+  });
+  print("ForStream(master, id)", [&master, &ids]() {
+    uint64_t sum = 0;
+    for (const uint64_t id : ids) {
+      sum += Engine::ForStream(master, id)();
+    }
+    return sum;
+  });
+  print("ForStream(master, \"user\", id)", [&master, &ids]() {
+    uint64_t sum = 0;
+    for (const uint64_t id : ids) {
+      sum += Engine::ForStream(master, "user", id)();
+    }
+    return sum;
+  });
+  // Both store all streams, which dominates for large "count".
+  print("streams[i] = ForStream(..)", [&master, &ids, &streams]() {
+    for (size_t i = 0; i < ids.size(); ++i) {
+      streams[i] = Engine::ForStream(master, ids[i]);
+    }
+    uint64_t sum = 0;
+    for (Engine& stream : streams) {
+      sum += stream();
+    }
+    return sum;
+  });
+  print("ForStreams(master, ids, ..)", [&master, &ids, &streams]() {
+    Engine::ForStreams(master, ids.data(), ids.size(), streams.data());
+    uint64_t sum = 0;
+    for (Engine& stream : streams) {
+      sum += stream();
+    }
+    return sum;
+  });
+}
+
+// Distribution of the latency of individual engine calls (or batches of
+// "batch_size" calls). Unlike the robust central tendency of Measure, this
+// reveals the cost of refills, e.g. every 30th Randen<uint64_t>() call
+// invokes Internal::Generate.
+class VisitorLatency : public EngineVisitor {
+ public:
+  explicit VisitorLatency(const size_t batch_size)
+      : batch_size_(batch_size), timer_overhead_(TimerOverhead()) {
+    printf("Ticks per batch of %zu call(s), minus timer overhead %u:\n",
+           batch_size_, timer_overhead_);
+    printf("%13s  %6s %6s %6s %6s %6s %8s\n", "", "p50", "p90", "p99",
+           "p99.9", "max", "mean");
+  }
+
+  template <class Engine>
+  void Visit(const char* caption) {
+    Engine engine;
+    // Ensures engine calls cannot be moved outside the timed region.
+    PreventElision(&engine);
+    for (size_t i = 0; i < kSamples; ++i) {  // warm up caches and predictors
+      PreventElision(engine());
+    }
+
+    std::vector<uint32_t> latencies(kSamples);
+    for (uint32_t& latency : latencies) {
+      const uint32_t t0 = timer::Start32();
+      for (size_t i = 0; i < batch_size_; ++i) {
+        PreventElision(engine());
+      }
+      const uint32_t t1 = timer::Stop32();
+      const uint32_t elapsed = t1 - t0;
+      latency = elapsed > timer_overhead_ ? elapsed - timer_overhead_ : 0;
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    const double mean =
+        std::accumulate(latencies.begin(), latencies.end(), 0.0) / kSamples;
+    printf("%13s: %6u %6u %6u %6u %6u %8.2f\n", caption,
+           Percentile(latencies, 0.5), Percentile(latencies, 0.9),
+           Percentile(latencies, 0.99), Percentile(latencies, 0.999),
+           latencies.back(), mean);
+  }
+
+ private:
+  // Enough for p99.9 to be determined by ~1000 samples.
+  static constexpr size_t kSamples = 1 << 20;
+
+  // Returns the most frequent duration of an empty timed region.
+  static uint32_t TimerOverhead() {
+    std::vector<uint32_t> samples(4096);
+    for (uint32_t& sample : samples) {
+      const uint32_t t0 = timer::Start32();
+      const uint32_t t1 = timer::Stop32();
+      sample = t1 - t0;
+    }
+    std::sort(samples.begin(), samples.end());
+    uint32_t mode = samples[0];
+    size_t mode_count = 0;
+    for (size_t begin = 0; begin < samples.size();) {
+      size_t end = begin;
+      while (end < samples.size() && samples[end] == samples[begin]) ++end;
+      if (end - begin > mode_count) {
+        mode = samples[begin];
+        mode_count = end - begin;
+      }
+      begin = end;
+    }
+    return mode;
+  }
+
+  // "sorted" must be in ascending order; "quantile" is in [0, 1).
+  static uint32_t Percentile(const std::vector<uint32_t>& sorted,
+                             const double quantile) {
+    return sorted[static_cast<size_t>(quantile * sorted.size())];
+  }
+
+  const size_t batch_size_;
+  const uint32_t timer_overhead_;
+};
+
+// Model of the duration of a benchmark call: fixed cost plus cost per byte.
+struct LinearFit {
+  double fixed_ticks;
+  double ticks_per_byte;
+};
+
+// Least-squares fit of ticks = a + b * bytes. Weighted by 1 / ticks^2, i.e.
+// minimizes relative errors, so that small sizes (which determine the fixed
+// cost) are not dominated by large ones. Ignores non-positive ticks (infinite
+// weight); returns false if fewer than two sizes remain.
+bool FitTicks(const std::vector<double>& bytes,
+              const std::vector<double>& ticks, LinearFit* fit) {
+  double sum_w = 0.0, sum_x = 0.0, sum_y = 0.0, sum_xx = 0.0, sum_xy = 0.0;
+  size_t num_points = 0;
+  for (size_t i = 0; i < bytes.size(); ++i) {
+    if (ticks[i] <= 0.0) continue;
+    ++num_points;
+    const double w = 1.0 / (ticks[i] * ticks[i]);
+    sum_w += w;
+    sum_x += w * bytes[i];
+    sum_y += w * ticks[i];
+    sum_xx += w * bytes[i] * bytes[i];
+    sum_xy += w * bytes[i] * ticks[i];
+  }
+  if (num_points < 2) return false;
+  fit->ticks_per_byte =
+      (sum_w * sum_xy - sum_x * sum_y) / (sum_w * sum_xx - sum_x * sum_x);
+  fit->fixed_ticks = (sum_y - fit->ticks_per_byte * sum_x) / sum_w;
+  return true;
+}
+
+// Measures each engine with a geometric range of sizes, from one number up
+// to "max_bytes" (beyond L2/L3), and fits a linear model. Each size is a
+// separate Measure call because the variability of the largest sizes would
+// otherwise swamp the differences measured for the small ones.
+template <class Benchmark>
+class VisitorSweep : public EngineVisitor {
+ public:
+  VisitorSweep(const int unpredictable1, const size_t max_bytes)
+      : benchmark_(static_cast<uint64_t>(max_bytes / sizeof(uint64_t) *
+                                         unpredictable1)) {
+    for (size_t bytes = sizeof(uint64_t); bytes <= max_bytes; bytes *= 4) {
+      sizes_.push_back(bytes * unpredictable1);
+    }
+  }
+
+  template <class Engine>
+  void Visit(const char* caption) {
+    Engine engine;
+    std::vector<double> bytes, ticks;
+    printf("%8s:", caption);
+    for (const size_t size : sizes_) {
+      Params p;
+      p.verbose = false;
+      // Large sizes take too long to reach the usual precision.
+      p.max_evals = size > (1u << 20) ? 1 : 4;
+      p.min_samples_per_eval = size > (1u << 24) ? 3 : 7;
+      Result result;
+      if (!MeasureBenchmark(engine, benchmark_, size / sizeof(uint64_t), p,
+                            &result)) {
+        continue;
+      }
+      bytes.push_back(static_cast<double>(size));
+      ticks.push_back(result.ticks);
+      if (size >= (1u << 20)) {
+        printf(" %zuM:%.2f", size >> 20, result.ticks / size);
+      } else if (size >= (1u << 10)) {
+        printf(" %zuK:%.2f", size >> 10, result.ticks / size);
+      } else {
+        printf(" %zu:%.2f", size, result.ticks / size);
+      }
+    }
+    printf(" cpb\n");
+    LinearFit fit;
+    if (!FitTicks(bytes, ticks, &fit)) return;
+    printf("%8s  setup %.1f ticks, marginal %.2f cpb\n", "",
+           fit.fixed_ticks, fit.ticks_per_byte);
+  }
+
+ private:
+  const Benchmark benchmark_;
+  std::vector<size_t> sizes_;  // bytes
+};
+
+// Passed to ForeachBenchmark; runs each benchmark with all selected engines.
+class RunSingleThreaded {
+ public:
+  RunSingleThreaded(const Selection& engines, const int unpredictable1,
+                    const bool perf_counters,
+                    std::vector<BenchmarkRecord>* records)
+      : engines_(engines),
+        unpredictable1_(unpredictable1),
+        perf_counters_(perf_counters),
+        records_(records) {}
+
+  template <class Benchmark>
+  void Visit() {
+    VisitorSingle<Benchmark> visitor(unpredictable1_, perf_counters_,
+                                     records_);
+    ForeachEngine(engines_, visitor);
+    printf("\n");
+  }
+
+ private:
+  const Selection& engines_;
+  const int unpredictable1_;
+  const bool perf_counters_;
+  std::vector<BenchmarkRecord>* records_;
+};
+
+// --geometry: Randen<uint64_t> with 1, 2, 4 and 8 buffers per refill (see
+// ChainedSponge). Their outputs are identical, so only the refill frequency
+// and size of the engine differ.
+class RunGeometry {
+ public:
+  explicit RunGeometry(const int unpredictable1)
+      : unpredictable1_(unpredictable1) {}
+
+  template <class Benchmark>
+  void Visit() {
+    printf("%s:\n", Benchmark::Name());
+    const Benchmark benchmark(
+        static_cast<uint64_t>(Benchmark::Num64() * unpredictable1_));
+    Print<Randen<uint64_t>>(1, benchmark);
+    Print<Randen<uint64_t, ChainedSponge<2>>>(2, benchmark);
+    Print<Randen<uint64_t, ChainedSponge<4>>>(4, benchmark);
+    Print<Randen<uint64_t, ChainedSponge<8>>>(8, benchmark);
+    printf("\n");
+  }
+
+ private:
+  template <class Engine, class Benchmark>
+  void Print(const int buffers, const Benchmark& benchmark) const {
+    constexpr int kRateBytes = Internal::kStateBytes - Internal::kCapacityBytes;
+    printf("%d x %d bytes (%4zu byte engine): %.2f refills/KiB, ", buffers,
+           kRateBytes, sizeof(Engine), 1024.0 / (buffers * kRateBytes));
+    Engine engine;
+    double cpb, mad;
+    if (MeasureCyclesPerByte(engine, unpredictable1_, benchmark, &cpb, &mad)) {
+      printf("%5.2f cpb (+/- %.3f)\n", cpb, mad);
+    } else {
+      printf("measurement failed\n");
+    }
+  }
+
+  const int unpredictable1_;
+};
+
+class RunSweep {
+ public:
+  RunSweep(const Selection& engines, const int unpredictable1,
+           const size_t max_bytes)
+      : engines_(engines),
+        unpredictable1_(unpredictable1),
+        max_bytes_(max_bytes) {}
+
+  template <class Benchmark>
+  void Visit() {
+    printf("%s sweep:\n", Benchmark::Name());
+    VisitorSweep<Benchmark> visitor(unpredictable1_, max_bytes_);
+    ForeachEngine(engines_, visitor);
+    printf("\n");
+  }
+
+ private:
+  const Selection& engines_;
+  const int unpredictable1_;
+  const size_t max_bytes_;
+};
+
+class RunScaling {
+ public:
+  RunScaling(const Selection& engines, const int unpredictable1,
+             const size_t max_threads)
+      : engines_(engines),
+        unpredictable1_(unpredictable1),
+        max_threads_(max_threads) {}
+
+  template <class Benchmark>
+  void Visit() {
+    printf("%s:\n", Benchmark::Name());
+    VisitorScaling<Benchmark> visitor(unpredictable1_, max_threads_);
+    ForeachEngine(engines_, visitor);
+    printf("\n");
+  }
+
+ private:
+  const Selection& engines_;
+  const int unpredictable1_;
+  const size_t max_threads_;
+};
+
+BenchmarkContext Context(const bool std_dists) {
+  BenchmarkContext context;
+  context.cpu = platform::BrandString();
+#ifdef __VERSION__
+  context.compiler = __VERSION__;
 #endif
+  context.flags = RANDEN_COMPILE_FLAGS;
+  if (std_dists) context.flags += " --std-dists";
+  return context;
+}
 
+// Prints the registered engines and benchmarks (for --list).
+void PrintNames() {
+  VisitorNames engine_names;
+  ForeachEngine(Selection(), engine_names);
+  VisitorNames benchmark_names;
+  ForeachBenchmark(Selection(), false, benchmark_names);
+  printf("Engines:");
+  for (const std::string& name : engine_names.names) {
+    printf(" %s", name.c_str());
+  }
+  printf("\nBenchmarks:");
+  for (const std::string& name : benchmark_names.names) {
+    printf(" %s", name.c_str());
+  }
   printf("\n");
 }
 
-void RunAll(int argc, char* argv[]) {
+// Returns whether all names in "engines" and "benchmarks" are registered.
+bool VerifySelection(const Selection& engines, const Selection& benchmarks) {
+  VisitorNames engine_names;
+  ForeachEngine(Selection(), engine_names);
+  VisitorNames benchmark_names;
+  ForeachBenchmark(Selection(), false, benchmark_names);
+  const char* unknown = engines.Unmatched(engine_names.names);
+  if (unknown == nullptr) unknown = benchmarks.Unmatched(benchmark_names.names);
+  if (unknown == nullptr) return true;
+  fprintf(stderr, "Unknown engine or benchmark '%s'; see --list.\n", unknown);
+  return false;
+}
+
+// Returns the number of regressions relative to the --compare file.
+int RunAll(int argc, char* argv[]) {
   // Immediately output any results (for non-local runs).
   setvbuf(stdout, nullptr, _IONBF, 0);
 
-  printf("Config: enable std=%d\n", USE_STD_DISTRIBUTIONS);
-
-  // Avoid migrating between cores - important on multi-socket systems.
+  // Optional CPU number; --threads[=N] instead measures throughput scaling on
+  // up to N threads (default: all CPUs), each pinned to a different CPU.
+  // --smt[=aes,int,mem] measures contention with an SMT sibling running those
+  // loads (default: all), on the first sibling pair or --smt-cpus=A,B (which
+  // implies --smt).
+  // --json=FILE / --csv=FILE write the single-threaded results to FILE, and
+  // --compare=FILE reports significant changes relative to such a file.
+  // --engine=A,B and --bench=C restrict the engines/benchmarks (see --list),
+  // and --std-dists uses std::uniform_*_distribution in the benchmarks.
+  // --latency[=N] prints percentiles of the duration of (N) engine calls.
+  // --perf also reports hardware event counts (Linux perf_event_open).
+  // --sweep[=BYTES] measures sizes from 8 bytes to BYTES (default 64 MiB) and
+  // fits a fixed + per-byte cost model.
+  // --fill[=BYTES] compares Fill and FillStream of BYTES (default 1 GiB).
+  // --geometry compares buffer sizes of Randen (see ChainedSponge).
+  // --streams[=N] measures deriving N (default 1M) engines via ForStream.
+  const char* json_path = nullptr;
+  const char* csv_path = nullptr;
+  const char* compare_path = nullptr;
+  Selection engines;
+  Selection benchmarks;
+  bool std_dists = false;
+  bool perf_counters = false;
   int cpu = -1;
-  if (argc == 2) {
-    cpu = strtol(argv[1], nullptr, 10);
+  size_t max_threads = 0;
+  size_t latency_batch = 0;
+  size_t sweep_bytes = 0;
+  size_t fill_bytes = 0;
+  bool geometry = false;
+  size_t num_streams = 0;
+  const char* smt_loads = nullptr;  // names; also set by --smt-cpus
+  int smt_cpu = -1, smt_sibling = -1;
+  for (int i = 1; i < argc; ++i) {
+    if (strncmp(argv[i], "--threads", 9) == 0) {
+      max_threads = (argv[i][9] == '=')
+                        ? strtoul(argv[i] + 10, nullptr, 10)
+                        : std::thread::hardware_concurrency();
+      max_threads = std::max<size_t>(max_threads, 1);
+    } else if (strncmp(argv[i], "--latency", 9) == 0) {
+      latency_batch =
+          (argv[i][9] == '=') ? strtoul(argv[i] + 10, nullptr, 10) : 1;
+      latency_batch = std::max<size_t>(latency_batch, 1);
+    } else if (strncmp(argv[i], "--sweep", 7) == 0) {
+      sweep_bytes = (argv[i][7] == '=') ? strtoull(argv[i] + 8, nullptr, 10)
+                                        : size_t(64) << 20;
+      sweep_bytes = std::max(sweep_bytes, sizeof(uint64_t));
+    } else if (strncmp(argv[i], "--fill", 6) == 0) {
+      fill_bytes = (argv[i][6] == '=') ? strtoull(argv[i] + 7, nullptr, 10)
+                                       : size_t(1) << 30;
+    } else if (strcmp(argv[i], "--geometry") == 0) {
+      geometry = true;
+    } else if (strncmp(argv[i], "--streams", 9) == 0) {
+      num_streams = (argv[i][9] == '=') ? strtoull(argv[i] + 10, nullptr, 10)
+                                        : size_t(1) << 20;
+    } else if (strncmp(argv[i], "--engine=", 9) == 0) {
+      engines = Selection(argv[i] + 9);
+    } else if (strncmp(argv[i], "--bench=", 8) == 0) {
+      benchmarks = Selection(argv[i] + 8);
+    } else if (strcmp(argv[i], "--std-dists") == 0) {
+      std_dists = true;
+    } else if (strcmp(argv[i], "--perf") == 0) {
+      perf_counters = true;
+    } else if (strcmp(argv[i], "--list") == 0) {
+      PrintNames();
+      return 0;
+    } else if (strncmp(argv[i], "--json=", 7) == 0) {
+      json_path = argv[i] + 7;
+    } else if (strncmp(argv[i], "--csv=", 6) == 0) {
+      csv_path = argv[i] + 6;
+    } else if (strncmp(argv[i], "--compare=", 10) == 0) {
+      compare_path = argv[i] + 10;
+    } else if (strncmp(argv[i], "--smt-cpus=", 11) == 0) {
+      RANDEN_CHECK(sscanf(argv[i] + 11, "%d,%d", &smt_cpu, &smt_sibling) == 2);
+      // Implies --smt (with all loads unless specified).
+      if (smt_loads == nullptr) smt_loads = "aes,int,mem";
+    } else if (strncmp(argv[i], "--smt", 5) == 0) {
+      smt_loads = argv[i][5] == '=' ? argv[i] + 6 : "aes,int,mem";
+    } else {
+      cpu = strtol(argv[i], nullptr, 10);
+    }
   }
-  platform::PinThreadToCPU(cpu);
+  if (!VerifySelection(engines, benchmarks)) return 1;
+
+  printf("Config: enable std=%d\n", std_dists);
 
   // Ensures the iteration counts are not compile-time constants.
   const int unpredictable1 = argc != 999;
 
-  ForeachEngine<BenchmarkLoop>(unpredictable1);
-  ForeachEngine<BenchmarkShuffle>(unpredictable1);
-  ForeachEngine<BenchmarkSample>(unpredictable1);
-  ForeachEngine<BenchmarkMonteCarlo>(unpredictable1);
+  if (smt_loads != nullptr) {
+    std::vector<CompetingLoad> loads = {CompetingLoad::kNone};
+    for (CompetingLoad load : {CompetingLoad::kAES, CompetingLoad::kInteger,
+                               CompetingLoad::kMemory}) {
+      if (strstr(smt_loads, LoadName(load)) != nullptr) loads.push_back(load);
+    }
+    RunSmt(engines, unpredictable1, loads, smt_cpu, smt_sibling);
+    return 0;
+  }
+
+  if (latency_batch != 0) {
+    platform::PinThreadToCPU(cpu);
+    VisitorLatency visitor(latency_batch);
+    ForeachEngine(engines, visitor);
+    return 0;
+  }
+
+  if (fill_bytes != 0) {
+    RunFill(fill_bytes, cpu);
+    return 0;
+  }
+
+  if (num_streams != 0) {
+    RunStreams(num_streams, cpu);
+    return 0;
+  }
+
+  if (geometry) {
+    platform::PinThreadToCPU(cpu);
+    RunGeometry runner(unpredictable1);
+    ForeachBenchmark(benchmarks, std_dists, runner);
+    return 0;
+  }
+
+  if (sweep_bytes != 0) {
+    platform::PinThreadToCPU(cpu);
+    RunSweep runner(engines, unpredictable1, sweep_bytes);
+    ForeachBenchmark(benchmarks, std_dists, runner);
+    return 0;
+  }
+
+  if (max_threads != 0) {
+    RunScaling runner(engines, unpredictable1, max_threads);
+    ForeachBenchmark(benchmarks, std_dists, runner);
+    return 0;
+  }
+
+  std::vector<BenchmarkRecord> baseline;
+  if (compare_path != nullptr &&
+      !ReadBenchmarkRecords(compare_path, &baseline)) {
+    fprintf(stderr, "Cannot read %s\n", compare_path);
+    return 1;
+  }
+
+  // Avoid migrating between cores - important on multi-socket systems.
+  platform::PinThreadToCPU(cpu);
+
+  std::vector<BenchmarkRecord> records;
+  RunSingleThreaded runner(engines, unpredictable1, perf_counters, &records);
+  ForeachBenchmark(benchmarks, std_dists, runner);
+
+  if (json_path != nullptr) {
+    RANDEN_CHECK(WriteJson(json_path, Context(std_dists), records));
+  }
+  if (csv_path != nullptr) {
+    RANDEN_CHECK(WriteCsv(csv_path, Context(std_dists), records));
+  }
+  if (compare_path == nullptr) return 0;
+  const size_t num_regressions = CompareBenchmarkRecords(baseline, records);
+  printf("%zu significant regression(s) relative to %s\n", num_regressions,
+         compare_path);
+  return static_cast<int>(num_regressions != 0);
 }
 
 }  // namespace
 }  // namespace randen
 
 int main(int argc, char* argv[]) {
-  randen::RunAll(argc, argv);
-  return 0;
+  return randen::RunAll(argc, argv);
 }
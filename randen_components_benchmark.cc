@@ -0,0 +1,197 @@
+// Copyright 2018 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures the stages of Internal::Generate separately (Permute, its rounds
+// and BlockShuffle) plus Absorb, with the round keys and state either in L1
+// ("warm") or evicted before each call ("cold", as when an application only
+// rarely draws random numbers). Eviction uses clflush or, with --pollute=N,
+// touches N bytes of other memory. Please disable Turbo Boost.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>  // _mm_clflush
+#define HAVE_CLFLUSH 1
+#else
+#define HAVE_CLFLUSH 0
+#endif
+
+#include "nanobenchmark.h"
+#include "randen.h"
+#include "timer.h"
+
+namespace randen {
+namespace {
+
+alignas(32) uint64_t state[Internal::kStateBytes / sizeof(uint64_t)];
+alignas(32) uint8_t seed[Internal::kStateBytes - Internal::kCapacityBytes];
+
+// If non-empty, Evict writes to each of its cache lines instead of flushing.
+std::vector<uint8_t> pollution;
+
+void Flush(const void* begin, const size_t bytes) {
+#if HAVE_CLFLUSH
+  const char* begin8 = static_cast<const char*>(begin);
+  for (size_t i = 0; i < bytes; i += 64) {
+    _mm_clflush(begin8 + i);
+  }
+  _mm_mfence();
+#endif
+}
+
+// Whether Evict is able to remove the keys/state from the caches.
+bool CanEvict() { return HAVE_CLFLUSH || !pollution.empty(); }
+
+// Removes the round keys and state from (at least) the L1 and L2 caches.
+void Evict() {
+  if (pollution.empty()) {
+    Flush(Internal::Keys(), Internal::kKeyBytes);
+    Flush(state, sizeof(state));
+    return;
+  }
+  for (size_t i = 0; i < pollution.size(); i += 64) {
+    pollution[i]++;
+  }
+  PreventElision(pollution[0]);
+}
+
+// Single calls of the faster stages are shorter than the timer overhead.
+constexpr FuncInput kCalls = 16;
+
+// Measures ticks per call of "stage" with warm caches. Returns false if the
+// measurement failed.
+template <class Stage>
+bool TicksWarm(const Stage& stage, double* ticks) {
+  const FuncInput inputs[1] = {kCalls};
+  Result results[1];
+  Params p;
+  p.verbose = false;
+  const auto closure = [&stage](const FuncInput calls) {
+    for (FuncInput i = 0; i < calls; ++i) {
+      stage();
+    }
+    return state[0];
+  };
+  // Retry because interruptions occasionally disturb the overhead estimate.
+  for (int attempt = 0; attempt < 3; ++attempt) {
+    if (MeasureClosure(closure, inputs, 1, results, p) == 1) {
+      *ticks = results[0].ticks / kCalls;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Returns the median duration [ticks] of single calls to "stage", each
+// preceded by Evict. Measure cannot exclude the eviction from its timed
+// region (and its cost varies, e.g. with the number of pending flushes), so
+// we time each call separately.
+template <class Stage>
+double MedianTicksAfterEvict(const Stage& stage) {
+  constexpr size_t kSamples = 1001;
+  std::vector<uint64_t> samples(kSamples);
+  for (uint64_t& sample : samples) {
+    Evict();
+    const uint64_t t0 = timer::Start64();
+    stage();
+    const uint64_t t1 = timer::Stop64();
+    PreventElision(state[0]);
+    sample = t1 - t0;
+  }
+  std::nth_element(samples.begin(), samples.begin() + kSamples / 2,
+                   samples.end());
+  return static_cast<double>(samples[kSamples / 2]);
+}
+
+// Ticks per call of "stage" after evicting the round keys and state,
+// excluding the timer overhead.
+template <class Stage>
+double TicksCold(const Stage& stage) {
+  const double overhead = MedianTicksAfterEvict([]() {});
+  return MedianTicksAfterEvict(stage) - overhead;
+}
+
+// Prints warm and (if supported) cold ticks per call and stores them in
+// "warm" and "cold" (negative if unsupported). Aborts if the measurement
+// failed.
+template <class Stage>
+void Print(const char* caption, const Stage& stage, double* warm,
+           double* cold) {
+  if (!TicksWarm(stage, warm)) {
+    fprintf(stderr, "Measurement of %s failed\n", caption);
+    exit(1);
+  }
+  printf("%-14s %9.1f", caption, *warm);
+  if (CanEvict()) {
+    *cold = TicksCold(stage);
+    printf(" %9.1f\n", *cold);
+  } else {
+    *cold = -1.0;
+    printf(" %9s\n", "-");
+  }
+}
+
+int RunAll(int argc, char* argv[]) {
+  for (int i = 1; i < argc; ++i) {
+    if (!strncmp(argv[i], "--pollute=", 10)) {
+      pollution.resize(strtoul(argv[i] + 10, nullptr, 0));
+    } else {
+      fprintf(stderr,
+              "Usage: %s [--pollute=BYTES]\n"
+              "Evicts with clflush unless BYTES (e.g. the LLC size) > 0.\n",
+              argv[0]);
+      return 1;
+    }
+  }
+
+  // Avoid migrating between cores - important on multi-socket systems.
+  platform::PinThreadToCPU();
+
+  for (size_t i = 0; i < sizeof(seed); ++i) {
+    seed[i] = static_cast<uint8_t>(i * 131 + 7);
+  }
+
+  printf("%-14s %9s %9s  (ticks per call)\n", "Stage", "warm", "cold");
+  double absorb, shuffle, round, permute, generate, cold;
+  Print("Absorb", []() { Internal::Absorb(seed, state); }, &absorb, &cold);
+  Print("BlockShuffle", []() { Internal::BlockShuffle(state); }, &shuffle,
+        &cold);
+  Print("FeistelRound",
+        []() { Internal::FeistelRound(state, Internal::Keys()); }, &round,
+        &cold);
+  Print("Permute", []() { Internal::Permute(state); }, &permute, &cold);
+  Print("Generate", []() { Internal::Generate(state); }, &generate, &cold);
+
+  constexpr int kBytes = Internal::kStateBytes - Internal::kCapacityBytes;
+  printf("\nPermute: %.1f ticks per round (%.0f%% BlockShuffle)\n",
+         permute / Internal::kRounds, shuffle * 100.0 / round);
+  printf("Generate: %.1f ticks outside Permute (byte swap, capacity XOR)\n",
+         generate - permute);
+  printf("Generate: %.3f ticks per byte (%d bytes); Absorb: %.3f per byte\n",
+         generate / kBytes, kBytes, absorb / sizeof(seed));
+  if (cold >= 0.0) {
+    printf("Refill (Generate) after eviction: %.1f ticks = %.1fx warm\n", cold,
+           cold / generate);
+  }
+  return 0;
+}
+
+}  // namespace
+}  // namespace randen
+
+int main(int argc, char* argv[]) { return randen::RunAll(argc, argv); }
@@ -0,0 +1,119 @@
+// Copyright 2018 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Seeding from the OS via getrandom (Linux), shared by the non-reproducible
+// engines: libranden_preload.so, PerCpu and RandenRing.
+
+#ifndef RANDEN_GETRANDOM_H_
+#define RANDEN_GETRANDOM_H_
+
+#include <errno.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+#include <atomic>
+
+#include "randen.h"
+
+namespace randen {
+
+// Aborts if the OS cannot provide entropy: callers have no way to report
+// failure, and continuing without a seed would be worse.
+inline void GetRandom(void* bytes, size_t size) {
+  uint8_t* pos = static_cast<uint8_t*>(bytes);
+  while (size != 0) {
+    const ssize_t ret = getrandom(pos, size, 0);
+    if (ret < 0) {
+      if (errno == EINTR) continue;
+      abort();
+    }
+    pos += ret;
+    size -= ret;
+  }
+}
+
+// SeedSequence for Randen::reseed.
+class GetRandomSeedSeq {
+ public:
+  using result_type = uint32_t;
+
+  template <class RandomIt>
+  void generate(RandomIt begin, RandomIt end) {
+    GetRandom(&*begin, (end - begin) * sizeof(result_type));
+  }
+};
+
+// Replaces a Randen state (Internal::kStateBytes) with a new seed, for callers
+// that use Internal::Generate directly.
+inline void SeedState(void* state) {
+  constexpr size_t kRateBytes =
+      Internal::kStateBytes - Internal::kCapacityBytes;
+  alignas(32) uint8_t seed[kRateBytes];
+  GetRandom(seed, sizeof(seed));
+  memset(state, 0, Internal::kStateBytes);
+  Internal::Absorb(seed, state);
+}
+
+// Number of forks since first use, in this process or its ancestors. The
+// child's only thread (the one that called fork) sees a new generation and
+// reseeds instead of repeating the parent's output.
+class ForkGeneration {
+ public:
+  static uint32_t Get() {
+    return Counter().generation_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  ForkGeneration() { pthread_atfork(nullptr, nullptr, &OnForkChild); }
+
+  static ForkGeneration& Counter() {
+    static ForkGeneration counter;
+    return counter;
+  }
+
+  static void OnForkChild() {
+    Counter().generation_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  std::atomic<uint32_t> generation_{0};
+};
+
+// Randen engine seeded via getrandom on first use and after fork; intended
+// for thread_local variables.
+template <typename T>
+class ReseedingEngine {
+ public:
+  Randen<T>& Get() {
+    const uint32_t generation = ForkGeneration::Get();
+    if (!seeded_ || generation_ != generation) {
+      GetRandomSeedSeq seq;
+      engine_.reseed(seq);
+      seeded_ = true;
+      generation_ = generation;
+    }
+    return engine_;
+  }
+
+ private:
+  Randen<T> engine_;
+  bool seeded_ = false;
+  uint32_t generation_ = 0;  // ForkGeneration::Get() when last seeded
+};
+
+}  // namespace randen
+
+#endif  // RANDEN_GETRANDOM_H_
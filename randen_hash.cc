@@ -0,0 +1,149 @@
+// Copyright 2018 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "randen_hash.h"
+
+#include <string.h>  // memcpy
+#include <algorithm>
+
+#include "randen_inl.h"
+
+namespace randen {
+namespace {
+
+// Initial value of the first capacity byte.
+constexpr uint8_t kDomainUnkeyed = 1;
+constexpr uint8_t kDomainKeyed = 2;
+
+// First padding byte after the key or message; the last byte of the block is
+// always XORed with 0x80 (pad10*1), so that all padded blocks are distinct.
+constexpr uint8_t kPadKey = 2;
+constexpr uint8_t kPadMessage = 1;
+
+constexpr int kCapacityLanes = RandenHash::kCapacityBytes / sizeof(uint64_t);
+constexpr int kRateLanes = RandenHash::kRateBytes / sizeof(uint64_t);
+
+// Without the Reverie feed-forward of Internal::Generate, which would not be
+// invertible.
+void Permute(uint64_t* RANDEN_RESTRICT state) {
+  inl::SwapIfBigEndian(state);
+  inl::Permute(state);
+  inl::SwapIfBigEndian(state);
+}
+
+// XORs a whole block of (unaligned) input into the rate.
+RANDEN_INLINE void XorBlock(const uint8_t* RANDEN_RESTRICT in,
+                            uint64_t* RANDEN_RESTRICT rate) {
+  for (int i = 0; i < kRateLanes; ++i) {
+    uint64_t lane;
+    memcpy(&lane, in + i * sizeof(uint64_t), sizeof(lane));
+    rate[i] ^= lane;
+  }
+}
+
+void XorBytes(const uint8_t* RANDEN_RESTRICT in, const size_t size,
+              uint8_t* RANDEN_RESTRICT rate) {
+  for (size_t i = 0; i < size; ++i) {
+    rate[i] ^= in[i];
+  }
+}
+
+}  // namespace
+
+void RandenHash::Init() {
+  memset(state_, 0, sizeof(state_));
+  reinterpret_cast<uint8_t*>(state_)[0] = kDomainUnkeyed;
+  pos_ = 0;
+}
+
+void RandenHash::Init(const void* key, const size_t key_size) {
+  memset(state_, 0, sizeof(state_));
+  reinterpret_cast<uint8_t*>(state_)[0] = kDomainKeyed;
+  pos_ = 0;
+  // Length prefix: otherwise key "k" with message Pad("y") + "m" would absorb
+  // the same blocks as key Pad("k") + "y" with message "m".
+  uint8_t encoded_size[8];
+  for (int i = 0; i < 8; ++i) {
+    encoded_size[i] = static_cast<uint8_t>(uint64_t{key_size} >> (8 * i));
+  }
+  Update(encoded_size, sizeof(encoded_size));
+  Update(key, key_size);
+  Pad(kPadKey);
+}
+
+void RandenHash::Update(const void* data, size_t size) {
+  const uint8_t* in = static_cast<const uint8_t*>(data);
+  uint8_t* rate = reinterpret_cast<uint8_t*>(state_) + kCapacityBytes;
+
+  // Complete the partial block, if any.
+  if (pos_ != 0) {
+    const size_t bytes = std::min(size, kRateBytes - pos_);
+    XorBytes(in, bytes, rate + pos_);
+    pos_ += bytes;
+    in += bytes;
+    size -= bytes;
+    if (pos_ != kRateBytes) return;
+    Permute(state_);
+    pos_ = 0;
+  }
+
+  while (size >= kRateBytes) {
+    XorBlock(in, state_ + kCapacityLanes);
+    Permute(state_);
+    in += kRateBytes;
+    size -= kRateBytes;
+  }
+
+  XorBytes(in, size, rate);
+  pos_ = size;
+}
+
+void RandenHash::Pad(const uint8_t pad) {
+  uint8_t* rate = reinterpret_cast<uint8_t*>(state_) + kCapacityBytes;
+  rate[pos_] ^= pad;
+  rate[kRateBytes - 1] ^= 0x80;
+  Permute(state_);
+  pos_ = 0;
+}
+
+void RandenHash::Final(void* out, const size_t size) {
+  Pad(kPadMessage);
+  Squeeze(out, size);
+}
+
+void RandenHash::Squeeze(void* out, size_t size) {
+  uint8_t* out8 = static_cast<uint8_t*>(out);
+  const uint8_t* rate = reinterpret_cast<const uint8_t*>(state_) +
+                        kCapacityBytes;
+  while (size != 0) {
+    if (pos_ == kRateBytes) {
+      Permute(state_);
+      pos_ = 0;
+    }
+    const size_t bytes = std::min(size, kRateBytes - pos_);
+    memcpy(out8, rate + pos_, bytes);
+    pos_ += bytes;
+    out8 += bytes;
+    size -= bytes;
+  }
+}
+
+void RandenHash::Hash(const void* data, const size_t size, void* out,
+                      const size_t out_size) {
+  RandenHash hash;
+  hash.Update(data, size);
+  hash.Final(out, out_size);
+}
+
+}  // namespace randen
@@ -0,0 +1,83 @@
+// Copyright 2018 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Sponge hash and extendable-output function (XOF) built on the Randen
+// permutation, optionally keyed (MAC, key derivation). Not yet reviewed by
+// cryptographers; do not rely on it where a standard hash is required.
+
+#ifndef RANDEN_HASH_H_
+#define RANDEN_HASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "randen.h"
+
+namespace randen {
+
+// Usage: Init (or the constructor), any number of Update, then Final, which
+// may be followed by Squeeze to obtain further output. Outputs of different
+// lengths are prefixes of each other, so callers requiring distinct outputs
+// per length should Update with the length.
+//
+// The capacity is 256 bits, which bounds generic attacks (e.g. collisions)
+// to 2^128 permutations; the rate is therefore 224 (not 240) bytes.
+// Unkeyed, keyed and the padding of key and message use distinct initial
+// capacity values or padding bytes (domain separation). Keys are prefixed
+// with their 64-bit length, so the key/message boundary is unambiguous.
+class alignas(32) RandenHash {
+ public:
+  static constexpr size_t kCapacityBytes = 32;
+  static constexpr size_t kRateBytes = Internal::kStateBytes - kCapacityBytes;
+
+  // Unkeyed.
+  RandenHash() { Init(); }
+  // Keyed: same as Init(key, key_size).
+  RandenHash(const void* key, size_t key_size) { Init(key, key_size); }
+
+  // Starts a new unkeyed hash.
+  void Init();
+
+  // Starts a new keyed hash (e.g. MAC). "key_size" is arbitrary; at least 16
+  // bytes of entropy are recommended.
+  void Init(const void* key, size_t key_size);
+
+  // Appends "size" bytes to the message. Must not be called after Final.
+  void Update(const void* data, size_t size);
+
+  // Ends the message and writes the first "size" bytes of output.
+  void Final(void* out, size_t size);
+
+  // Writes the next "size" bytes of output. Must be called after Final.
+  void Squeeze(void* out, size_t size);
+
+  // One-shot unkeyed hash.
+  static void Hash(const void* data, size_t size, void* out, size_t out_size);
+
+ private:
+  // Completes the current (possibly empty) block with "pad" and permutes.
+  void Pad(uint8_t pad);
+
+  // First kCapacityBytes are inaccessible; message bytes are XORed into the
+  // rest, which is also the output.
+  alignas(32) uint64_t state_[Internal::kStateBytes / sizeof(uint64_t)];
+  // Offset within the rate: bytes absorbed into the current block, or after
+  // Final (which resets it to 0), bytes squeezed from it; kRateBytes means
+  // the next Squeeze permutes first.
+  size_t pos_;
+};
+
+}  // namespace randen
+
+#endif  // RANDEN_HASH_H_
@@ -0,0 +1,199 @@
+// Copyright 2018 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Compares RandenHash with a portable SHA-256 (FIPS 180-4) reference. The
+// reference does not use SHA extensions, so it is a baseline for portable
+// code, not for an optimized library.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "nanobenchmark.h"
+#include "randen_hash.h"
+
+namespace randen {
+namespace {
+
+class Sha256 {
+ public:
+  static void Hash(const uint8_t* data, const size_t size, uint8_t* out) {
+    uint32_t h[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                     0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    size_t pos = 0;
+    for (; pos + 64 <= size; pos += 64) {
+      Compress(data + pos, h);
+    }
+
+    uint8_t last[128] = {0};
+    const size_t tail = size - pos;
+    memcpy(last, data + pos, tail);
+    last[tail] = 0x80;
+    const size_t last_size = (tail < 56) ? 64 : 128;
+    const uint64_t bits = static_cast<uint64_t>(size) * 8;
+    for (int i = 0; i < 8; ++i) {
+      last[last_size - 1 - i] = static_cast<uint8_t>(bits >> (8 * i));
+    }
+    for (size_t i = 0; i < last_size; i += 64) {
+      Compress(last + i, h);
+    }
+
+    for (int i = 0; i < 8; ++i) {
+      for (int j = 0; j < 4; ++j) {
+        out[4 * i + j] = static_cast<uint8_t>(h[i] >> (24 - 8 * j));
+      }
+    }
+  }
+
+ private:
+  static uint32_t Rotr(const uint32_t x, const int n) {
+    return (x >> n) | (x << (32 - n));
+  }
+
+  static void Compress(const uint8_t* block, uint32_t* h) {
+    static const uint32_t kK[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+        0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+        0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+        0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+        0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+        0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+        0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+        0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+        0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+    uint32_t w[64];
+    for (int i = 0; i < 16; ++i) {
+      const uint8_t* word = block + 4 * i;
+      w[i] = (uint32_t{word[0]} << 24) | (uint32_t{word[1]} << 16) |
+             (uint32_t{word[2]} << 8) | word[3];
+    }
+    for (int i = 16; i < 64; ++i) {
+      const uint32_t s0 =
+          Rotr(w[i - 15], 7) ^ Rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+      const uint32_t s1 =
+          Rotr(w[i - 2], 17) ^ Rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+      w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
+    uint32_t e = h[4], f = h[5], g = h[6], k = h[7];
+    for (int i = 0; i < 64; ++i) {
+      const uint32_t s1 = Rotr(e, 6) ^ Rotr(e, 11) ^ Rotr(e, 25);
+      const uint32_t ch = (e & f) ^ (~e & g);
+      const uint32_t t1 = k + s1 + ch + kK[i] + w[i];
+      const uint32_t s0 = Rotr(a, 2) ^ Rotr(a, 13) ^ Rotr(a, 22);
+      const uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+      const uint32_t t2 = s0 + maj;
+      k = g;
+      g = f;
+      f = e;
+      e = d + t1;
+      d = c;
+      c = b;
+      b = a;
+      a = t1 + t2;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+    h[5] += f;
+    h[6] += g;
+    h[7] += k;
+  }
+};
+
+bool VerifySha256() {
+  const uint8_t kExpected[32] = {
+      0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40,
+      0xde, 0x5d, 0xae, 0x22, 0x23, 0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17,
+      0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad};
+  uint8_t digest[32];
+  Sha256::Hash(reinterpret_cast<const uint8_t*>("abc"), 3, digest);
+  return memcmp(digest, kExpected, 32) == 0;
+}
+
+// Returns ticks per call of "closure", or a negative value if the
+// measurement failed.
+template <class Closure>
+double Ticks(const Closure& closure) {
+  const FuncInput inputs[1] = {0};
+  Result results[1];
+  Params p;
+  p.verbose = false;
+  // Retry because interruptions occasionally disturb the overhead estimate.
+  for (int attempt = 0; attempt < 3; ++attempt) {
+    if (MeasureClosure(closure, inputs, 1, results, p) == 1) {
+      return results[0].ticks;
+    }
+  }
+  return -1.0;
+}
+
+void PrintCyclesPerByte(const double ticks, const size_t size) {
+  if (ticks >= 0.0) {
+    printf(" %9.2f", ticks / size);
+  } else {
+    printf(" %9s", "-");
+  }
+}
+
+int RunAll() {
+  if (!VerifySha256()) {
+    fprintf(stderr, "SHA-256 reference is incorrect.\n");
+    return 1;
+  }
+
+  // Avoid migrating between cores - important on multi-socket systems.
+  platform::PinThreadToCPU();
+
+  printf("%-9s %9s %9s  (cycles per byte, 32-byte digest)\n", "Bytes",
+         "Randen", "SHA-256");
+  for (size_t size : {size_t{64}, size_t{1024}, size_t{64 << 10},
+                      size_t{1 << 20}}) {
+    std::vector<uint8_t> message(size);
+    for (size_t i = 0; i < size; ++i) {
+      message[i] = static_cast<uint8_t>(i);
+    }
+    uint8_t digest[32];
+
+    const double randen = Ticks([&message, &digest](const FuncInput input) {
+      message[0] = static_cast<uint8_t>(input);
+      RandenHash::Hash(message.data(), message.size(), digest, 32);
+      return static_cast<FuncOutput>(digest[0]);
+    });
+    const double sha = Ticks([&message, &digest](const FuncInput input) {
+      message[0] = static_cast<uint8_t>(input);
+      Sha256::Hash(message.data(), message.size(), digest);
+      return static_cast<FuncOutput>(digest[0]);
+    });
+
+    printf("%-9zu", size);
+    PrintCyclesPerByte(randen, size);
+    PrintCyclesPerByte(sha, size);
+    printf("\n");
+  }
+  return 0;
+}
+
+}  // namespace
+}  // namespace randen
+
+int main(int argc, char* argv[]) { return randen::RunAll(); }
@@ -0,0 +1,208 @@
+// Copyright 2018 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "randen_hash.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#define UPDATE_GOLDEN 0
+
+namespace randen {
+namespace {
+
+#define STR(x) #x
+
+#define ASSERT_TRUE(condition)                                                \
+  do {                                                                        \
+    if (!(condition)) {                                                       \
+      printf("Assertion [" STR(condition) "] failed on line %d\n", __LINE__); \
+      abort();                                                                \
+    }                                                                         \
+  } while (false)
+
+// Deterministic message of any length.
+std::vector<uint8_t> Message(const size_t size) {
+  std::vector<uint8_t> message(size);
+  for (size_t i = 0; i < size; ++i) {
+    message[i] = static_cast<uint8_t>(i * 131 + (i >> 8) + 7);
+  }
+  return message;
+}
+
+void Digest(const std::vector<uint8_t>& message, uint8_t* out) {
+  RandenHash::Hash(message.data(), message.size(), out, 32);
+}
+
+void VerifyGolden() {
+  const size_t kSizes[3] = {0, 3, 1000};
+  const uint8_t golden[3][32] = {
+      {0xbf, 0x7f, 0x80, 0x46, 0x1a, 0x05, 0xa1, 0xa7, 0x29, 0xc7, 0xe1, 0x08,
+       0x4e, 0x75, 0x3b, 0xae, 0xa4, 0x94, 0x9e, 0x39, 0xa3, 0x5b, 0xfa, 0x34,
+       0x8a, 0xa5, 0x86, 0xa5, 0x6f, 0x4e, 0x94, 0xdb},
+      {0xec, 0xcb, 0x9f, 0x21, 0x54, 0x65, 0x54, 0x9f, 0x4e, 0x56, 0xaf, 0x7b,
+       0x03, 0xe9, 0xb7, 0x23, 0x57, 0xfd, 0x89, 0x59, 0xf9, 0xfa, 0x17, 0xd2,
+       0xe7, 0xaa, 0xad, 0x9b, 0xb9, 0x22, 0x02, 0x9e},
+      {0x9d, 0xa4, 0x10, 0x83, 0x52, 0x11, 0xc7, 0x3c, 0xa6, 0x9a, 0x57, 0x09,
+       0x7b, 0xbc, 0xae, 0x4e, 0xf9, 0x04, 0x24, 0xac, 0x1b, 0xa5, 0xe0, 0x41,
+       0xd7, 0x80, 0x4e, 0x14, 0x02, 0x25, 0x97, 0x48}};
+  for (int i = 0; i < 3; ++i) {
+    uint8_t digest[32];
+    Digest(Message(kSizes[i]), digest);
+#if UPDATE_GOLDEN
+    printf("{");
+    for (int j = 0; j < 32; ++j) {
+      printf("0x%02x,%s", digest[j], (j % 12 == 11) ? "\n" : " ");
+    }
+    printf("},\n");
+#else
+    ASSERT_TRUE(memcmp(digest, golden[i], 32) == 0);
+#endif
+  }
+}
+
+// Any split of the message into Update calls yields the same digest.
+void VerifyIncremental() {
+  const size_t kRate = RandenHash::kRateBytes;
+  for (size_t size : {size_t{0}, size_t{1}, kRate - 1, kRate, kRate + 1,
+                      3 * kRate, 3 * kRate + 5}) {
+    const std::vector<uint8_t> message = Message(size);
+    uint8_t expected[48];
+    RandenHash::Hash(message.data(), size, expected, sizeof(expected));
+
+    for (size_t chunk : {size_t{1}, size_t{7}, kRate - 1, kRate, kRate + 3}) {
+      RandenHash hash;
+      for (size_t pos = 0; pos < size; pos += chunk) {
+        hash.Update(message.data() + pos, std::min(chunk, size - pos));
+      }
+      uint8_t actual[48];
+      hash.Final(actual, sizeof(actual));
+      ASSERT_TRUE(memcmp(expected, actual, sizeof(actual)) == 0);
+    }
+  }
+}
+
+// Output of any length is a prefix of longer output, also across Squeeze.
+void VerifyXof() {
+  const std::vector<uint8_t> message = Message(100);
+  const size_t kOutBytes = 3 * RandenHash::kRateBytes + 11;
+  uint8_t expected[kOutBytes];
+  RandenHash::Hash(message.data(), message.size(), expected, kOutBytes);
+
+  for (size_t first : {size_t{0}, size_t{1}, size_t{223}, size_t{224},
+                       size_t{500}}) {
+    RandenHash hash;
+    hash.Update(message.data(), message.size());
+    uint8_t actual[kOutBytes];
+    hash.Final(actual, first);
+    for (size_t pos = first; pos < kOutBytes; pos += 100) {
+      hash.Squeeze(actual + pos, std::min<size_t>(100, kOutBytes - pos));
+    }
+    ASSERT_TRUE(memcmp(expected, actual, kOutBytes) == 0);
+  }
+
+  // Not all zero or repeating blocks.
+  ASSERT_TRUE(memcmp(expected, expected + RandenHash::kRateBytes,
+                     RandenHash::kRateBytes) != 0);
+}
+
+// Messages that differ only in padding-like suffixes, and keyed vs.
+// unkeyed hashes of the same bytes, all differ.
+void VerifyDomainSeparation() {
+  std::vector<std::vector<uint8_t>> digests;
+  const auto add = [&digests](RandenHash* hash) {
+    std::vector<uint8_t> digest(32);
+    hash->Final(digest.data(), digest.size());
+    for (const std::vector<uint8_t>& other : digests) {
+      ASSERT_TRUE(other != digest);
+    }
+    digests.push_back(digest);
+  };
+
+  const uint8_t bytes[4] = {'a', 'b', 'c', 0};
+  RandenHash hash;
+  hash.Update(bytes, 3);  // "abc"
+  add(&hash);
+  hash.Init();
+  hash.Update(bytes, 4);  // "abc\0"
+  add(&hash);
+  hash.Init();
+  const uint8_t padded[2] = {'a', 1};  // as if padding were data
+  hash.Update(padded, 2);
+  add(&hash);
+  hash.Init();
+  hash.Update(bytes, 1);
+  add(&hash);
+  hash.Init(bytes, 3);  // key "abc", empty message
+  add(&hash);
+  hash.Init(bytes, 2);  // key "ab", message "c"
+  hash.Update(bytes + 2, 1);
+  add(&hash);
+  hash.Init(bytes + 1, 2);  // different key
+  add(&hash);
+  hash.Init(nullptr, 0);  // empty key differs from unkeyed
+  add(&hash);
+  hash.Init();
+  add(&hash);
+
+  // The key/message boundary is unambiguous: key "k" with message
+  // PadKey("y") + "m" vs. key PadKey("k") + "y" with message "m", where
+  // PadKey(x) is the block absorbed for a key x without length prefix.
+  const auto pad_key = [](const uint8_t key) {
+    std::vector<uint8_t> block(RandenHash::kRateBytes, 0);
+    block[0] = key;
+    block[1] = 2;  // kPadKey
+    block.back() = 0x80;
+    return block;
+  };
+  const uint8_t m = 'm';
+  std::vector<uint8_t> message1 = pad_key('y');
+  message1.push_back(m);
+  const uint8_t k = 'k';
+  hash.Init(&k, 1);
+  hash.Update(message1.data(), message1.size());
+  add(&hash);
+  std::vector<uint8_t> key2 = pad_key('k');
+  key2.push_back('y');
+  hash.Init(key2.data(), key2.size());
+  hash.Update(&m, 1);
+  add(&hash);
+
+  // Full block vs. the same block plus an empty one.
+  const std::vector<uint8_t> block = Message(RandenHash::kRateBytes);
+  hash.Init();
+  hash.Update(block.data(), block.size() - 1);
+  add(&hash);
+  hash.Init();
+  hash.Update(block.data(), block.size());
+  add(&hash);
+}
+
+void RunAll() {
+  VerifyGolden();
+  VerifyIncremental();
+  VerifyXof();
+  VerifyDomainSeparation();
+}
+
+}  // namespace
+}  // namespace randen
+
+int main(int argc, char* argv[]) {
+  randen::RunAll();
+  return 0;
+}
@@ -0,0 +1,247 @@
+// Copyright 2018 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "randen_percpu.h"
+
+#include <pthread.h>
+#include <sched.h>  // sched_getcpu
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <mutex>
+#include <new>
+
+#include "randen.h"
+#include "randen_getrandom.h"
+
+// The critical section is x86-64 assembly; glibc >= 2.35 registers the rseq
+// area of each thread and exports its location.
+#if defined(__x86_64__) && defined(__GLIBC__) && \
+    (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 35))
+#define RANDEN_RSEQ 1
+#include <sys/rseq.h>
+#else
+#define RANDEN_RSEQ 0
+#endif
+
+namespace randen {
+namespace {
+
+constexpr size_t kStateLanes = Internal::kStateBytes / sizeof(uint64_t);
+constexpr size_t kCapacityLanes = Internal::kCapacityBytes / sizeof(uint64_t);
+
+// Fallback: one engine per thread.
+thread_local ReseedingEngine<uint64_t> thread_engine;
+
+uint64_t ThreadLocalNext() { return thread_engine.Get()(); }
+
+#if RANDEN_RSEQ
+
+// The critical section accesses "state" and "next" at these offsets.
+struct Buffer {
+  alignas(32) uint64_t state[kStateLanes];
+  // Index of the next value in state; kStateLanes if depleted. Only written
+  // by the critical section (if less) or with the lock held (if equal).
+  uint64_t next;
+};
+static_assert(offsetof(Buffer, next) == Internal::kStateBytes, "Layout");
+
+struct alignas(64) Slot {
+  Buffer buffer;
+  std::mutex mutex;  // held during refills
+  bool seeded = false;
+};
+
+// Returns the highest possible CPU number plus one, which may exceed the
+// number of CPUs if their numbering is sparse, or 0 if unknown.
+long NumCpuIds() {
+  FILE* file = fopen("/sys/devices/system/cpu/possible", "r");
+  if (file == nullptr) return 0;
+  // Ranges such as "0-3,8-11"; the last number is the highest.
+  long last = -1, number;
+  while (fscanf(file, "%ld", &number) == 1) {
+    last = number;
+    if (fgetc(file) == EOF) break;
+  }
+  fclose(file);
+  return last + 1;
+}
+
+struct Slots {
+  Slots() {
+    long num_cpus = NumCpuIds();
+    if (num_cpus <= 0) num_cpus = sysconf(_SC_NPROCESSORS_CONF);
+    if (__rseq_size == 0 || num_cpus <= 0) return;
+    void* allocated;
+    if (posix_memalign(&allocated, alignof(Slot), num_cpus * sizeof(Slot))) {
+      return;
+    }
+    slots = static_cast<Slot*>(allocated);
+    num_slots = static_cast<size_t>(num_cpus);
+    for (size_t i = 0; i < num_slots; ++i) {
+      Slot* slot = new (slots + i) Slot;
+      slot->buffer.next = kStateLanes;
+    }
+    pthread_atfork(&LockAll, &UnlockAll, &OnForkChild);
+  }
+
+  // Ensures the child does not inherit a held lock.
+  static void LockAll();
+  static void UnlockAll();
+
+  // The child reseeds instead of repeating the parent's output.
+  static void OnForkChild();
+
+  Slot* slots = nullptr;  // never freed (used until exit)
+  size_t num_slots = 0;
+};
+
+Slots& GetSlots() {
+  static Slots slots;
+  return slots;
+}
+
+void Slots::LockAll() {
+  Slots& all = GetSlots();
+  for (size_t i = 0; i < all.num_slots; ++i) {
+    all.slots[i].mutex.lock();
+  }
+}
+
+void Slots::UnlockAll() {
+  Slots& all = GetSlots();
+  for (size_t i = 0; i < all.num_slots; ++i) {
+    all.slots[i].mutex.unlock();
+  }
+}
+
+void Slots::OnForkChild() {
+  Slots& all = GetSlots();
+  for (size_t i = 0; i < all.num_slots; ++i) {
+    all.slots[i].buffer.next = kStateLanes;
+    all.slots[i].seeded = false;
+  }
+  UnlockAll();
+}
+
+enum class Status { kOk, kDepleted, kAborted, kNoSlot };
+
+// Reads the next value of the current CPU's buffer into "value" and advances
+// its position, unless the buffer is depleted, the CPU has no slot (CPU
+// numbers should be less than num_slots, but we do not rely on that) or the
+// kernel restarted the sequence (preemption, migration or signal) before the
+// commit.
+Status TryNext(Slot* slots, size_t num_slots, uint64_t* value) {
+  __asm__ __volatile__ goto(
+      // struct rseq_cs: version, flags, start_ip, post_commit_offset,
+      // abort_ip.
+      ".pushsection __rseq_cs, \"aw\"\n\t"
+      ".balign 32\n\t"
+      "3:\n\t"
+      ".long 0x0, 0x0\n\t"
+      ".quad 1f, (2f - 1f), 4f\n\t"
+      ".popsection\n\t"
+      // Register the critical section in rseq->rseq_cs.
+      "leaq 3b(%%rip), %%rax\n\t"
+      "movq %%rax, %%fs:8(%[rseq_offset])\n\t"
+      "1:\n\t"
+      // rax = &slots[rseq->cpu_id]
+      "movl %%fs:4(%[rseq_offset]), %%eax\n\t"
+      "cmpq %[num_slots], %%rax\n\t"
+      "jae %l[no_slot]\n\t"
+      "imulq %[slot_bytes], %%rax\n\t"
+      "addq %[slots], %%rax\n\t"
+      "movq %c[next](%%rax), %%rcx\n\t"
+      "cmpq %[state_lanes], %%rcx\n\t"
+      "jae %l[depleted]\n\t"
+      "movq (%%rax, %%rcx, 8), %%rdx\n\t"
+      "movq %%rdx, (%[value])\n\t"
+      "incq %%rcx\n\t"
+      "movq %%rcx, %c[next](%%rax)\n\t"  // commit
+      "2:\n\t"
+      // The abort handler must be preceded by the signature.
+      ".pushsection __rseq_failure, \"ax\"\n\t"
+      ".byte 0x0f, 0xb9, 0x3d\n\t"  // ud1 with the signature as disp32
+      ".long %c[signature]\n\t"
+      "4:\n\t"
+      "jmp %l[aborted]\n\t"
+      ".popsection\n\t"
+      :
+      : [rseq_offset] "r"(__rseq_offset), [slots] "r"(slots),
+        [num_slots] "r"(num_slots), [value] "r"(value),
+        [slot_bytes] "i"(sizeof(Slot)),
+        [next] "i"(offsetof(Buffer, next)), [state_lanes] "i"(kStateLanes),
+        [signature] "i"(RSEQ_SIG)
+      : "memory", "cc", "rax", "rcx", "rdx"
+      : depleted, aborted, no_slot);
+  return Status::kOk;
+depleted:
+  return Status::kDepleted;
+aborted:
+  return Status::kAborted;
+no_slot:
+  return Status::kNoSlot;
+}
+
+// Refills the buffer of the CPU we are (probably still) running on.
+void Refill(Slots& all) {
+  const int cpu = sched_getcpu();
+  // Retry; TryNext falls back to ThreadLocalNext if there is no slot.
+  if (cpu < 0 || static_cast<size_t>(cpu) >= all.num_slots) return;
+  Slot& slot = all.slots[cpu];
+  std::lock_guard<std::mutex> lock(slot.mutex);
+  // Another thread may have refilled it already.
+  if (__atomic_load_n(&slot.buffer.next, __ATOMIC_ACQUIRE) < kStateLanes) {
+    return;
+  }
+  if (!slot.seeded) {
+    SeedState(slot.buffer.state);
+    slot.seeded = true;
+  }
+  // Critical sections see "next" = kStateLanes until the store below, so
+  // they do not read the state while it is being updated.
+  Internal::Generate(slot.buffer.state);
+  __atomic_store_n(&slot.buffer.next, kCapacityLanes, __ATOMIC_RELEASE);
+}
+
+#endif  // RANDEN_RSEQ
+
+}  // namespace
+
+uint64_t PerCpuInternal::Next() {
+#if RANDEN_RSEQ
+  Slots& all = GetSlots();
+  if (all.num_slots != 0) {
+    uint64_t value;
+    for (;;) {
+      const Status status = TryNext(all.slots, all.num_slots, &value);
+      if (status == Status::kOk) return value;
+      if (status == Status::kDepleted) Refill(all);
+      if (status == Status::kNoSlot) break;
+    }
+  }
+#endif
+  return ThreadLocalNext();
+}
+
+bool PerCpuInternal::UsesRseq() {
+#if RANDEN_RSEQ
+  return GetSlots().num_slots != 0;
+#else
+  return false;
+#endif
+}
+
+}  // namespace randen
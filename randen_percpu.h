@@ -0,0 +1,73 @@
+// Copyright 2018 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Randen engines shared by all threads running on the same CPU, for services
+// with many mostly idle threads: memory and seeding work scale with the number
+// of CPUs, not threads.
+
+#ifndef RANDEN_PERCPU_H_
+#define RANDEN_PERCPU_H_
+
+#include <stdint.h>
+#include <limits>
+#include <type_traits>
+
+namespace randen {
+
+// Implementation of PerCpu, see randen_percpu.cc.
+struct PerCpuInternal {
+  // Returns the next value from the current CPU's engine.
+  static uint64_t Next();
+
+  static bool UsesRseq();
+};
+
+// C++11 URBG returning values from the current CPU's engine. Without atomics
+// or locks: each call is a Linux restartable sequence (rseq) that reads the
+// next value and commits the new position, and is restarted if the thread is
+// preempted or migrated in between. Only refills (every 30 values per CPU)
+// take a per-CPU lock. Where rseq is unavailable (requires x86-64 and glibc
+// 2.35, and may be disabled via GLIBC_TUNABLES=glibc.pthread.rseq=0), falls
+// back to an engine per thread.
+//
+// Engines are seeded via getrandom on first use, and again in the child
+// process after fork. Outputs are not reproducible; use Randen for that.
+// Values of types narrower than uint64_t are the lower bits of a 64-bit value.
+template <typename T>
+class PerCpu {
+  static_assert(std::is_unsigned<T>::value && sizeof(T) <= sizeof(uint64_t),
+                "PerCpu must be parameterized by a built-in unsigned integer");
+
+ public:
+  using result_type = T;
+
+  static constexpr result_type min() {
+    return std::numeric_limits<result_type>::min();
+  }
+
+  static constexpr result_type max() {
+    return std::numeric_limits<result_type>::max();
+  }
+
+  result_type operator()() const {
+    return static_cast<result_type>(PerCpuInternal::Next());
+  }
+
+  // Whether engines are per CPU (otherwise per thread).
+  static bool UsesRseq() { return PerCpuInternal::UsesRseq(); }
+};
+
+}  // namespace randen
+
+#endif  // RANDEN_PERCPU_H_
@@ -0,0 +1,141 @@
+// Copyright 2018 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "randen_percpu.h"
+
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace randen {
+namespace {
+
+#define STR(x) #x
+
+#define ASSERT_TRUE(condition)                                                \
+  do {                                                                        \
+    if (!(condition)) {                                                       \
+      printf("Assertion [" STR(condition) "] failed on line %d\n", __LINE__); \
+      abort();                                                                \
+    }                                                                         \
+  } while (false)
+
+// Set in the child process that verifies the thread-local fallback.
+constexpr char kFallbackEnv[] = "RANDEN_PERCPU_FALLBACK";
+
+// Threads sharing an engine never receive the same value. Many more threads
+// than CPUs ensure preemption within critical sections.
+void VerifyNoDuplicates() {
+  constexpr size_t kThreads = 32;
+  constexpr size_t kValuesPerThread = 20000;
+  std::vector<uint64_t> values(kThreads * kValuesPerThread);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&values, t]() {
+      PerCpu<uint64_t> rng;
+      uint64_t* out = values.data() + t * kValuesPerThread;
+      for (size_t i = 0; i < kValuesPerThread; ++i) {
+        out[i] = rng();
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  std::sort(values.begin(), values.end());
+  ASSERT_TRUE(std::adjacent_find(values.begin(), values.end()) ==
+              values.end());
+}
+
+// The child process does not repeat the parent's values.
+void VerifyFork() {
+  PerCpu<uint64_t> rng;
+  (void)rng();  // seeded before fork
+  int fds[2];
+  ASSERT_TRUE(pipe(fds) == 0);
+  const pid_t pid = fork();
+  ASSERT_TRUE(pid >= 0);
+  uint64_t values[4];
+  for (uint64_t& value : values) {
+    value = rng();
+  }
+  if (pid == 0) {
+    const ssize_t written = write(fds[1], values, sizeof(values));
+    _exit(written == sizeof(values) ? 0 : 1);
+  }
+  uint64_t child_values[4];
+  ASSERT_TRUE(read(fds[0], child_values, sizeof(child_values)) ==
+              sizeof(child_values));
+  int status;
+  ASSERT_TRUE(waitpid(pid, &status, 0) == pid && status == 0);
+  close(fds[0]);
+  close(fds[1]);
+  ASSERT_TRUE(memcmp(values, child_values, sizeof(values)) != 0);
+}
+
+void VerifyDistribution() {
+  PerCpu<uint32_t> rng;
+  std::uniform_int_distribution<uint32_t> dist(0, 9);
+  size_t counts[10] = {0};
+  for (int i = 0; i < 100000; ++i) {
+    ++counts[dist(rng)];
+  }
+  for (const size_t count : counts) {
+    ASSERT_TRUE(9000 < count && count < 11000);
+  }
+}
+
+// Runs this test again with rseq disabled via glibc tunable.
+void VerifyFallback(const char* self) {
+  char tunables[] = "GLIBC_TUNABLES=glibc.pthread.rseq=0";
+  char fallback[] = "RANDEN_PERCPU_FALLBACK=1";
+  char* const envp[] = {tunables, fallback, nullptr};
+  char* const argv[] = {const_cast<char*>(self), nullptr};
+  pid_t pid;
+  ASSERT_TRUE(posix_spawn(&pid, "/proc/self/exe", nullptr, nullptr, argv,
+                          envp) == 0);
+  int status;
+  ASSERT_TRUE(waitpid(pid, &status, 0) == pid);
+  ASSERT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+void RunAll(const char* self) {
+  const bool is_fallback = getenv(kFallbackEnv) != nullptr;
+  if (is_fallback) {
+    ASSERT_TRUE(!PerCpu<uint64_t>::UsesRseq());
+  }
+
+  VerifyNoDuplicates();
+  VerifyFork();
+  VerifyDistribution();
+
+  if (!is_fallback && PerCpu<uint64_t>::UsesRseq()) {
+    VerifyFallback(self);
+  }
+}
+
+}  // namespace
+}  // namespace randen
+
+int main(int argc, char* argv[]) {
+  randen::RunAll(argv[0]);
+  return 0;
+}
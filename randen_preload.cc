@@ -0,0 +1,69 @@
+// Copyright 2018 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// lib/libranden_preload.so: arc4random, arc4random_buf and arc4random_uniform
+// (as in BSD and glibc 2.36) backed by a Randen engine per thread, seeded via
+// getrandom. Speeds up unmodified binaries that use them:
+//   LD_PRELOAD=lib/libranden_preload.so program
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "randen.h"
+#include "randen_getrandom.h"
+
+namespace randen {
+namespace {
+
+// Libraries loaded at startup (including via LD_PRELOAD) are part of the
+// static TLS block, so we can avoid the __tls_get_addr call.
+thread_local ReseedingEngine<uint32_t> thread_engine
+    __attribute__((tls_model("initial-exec")));
+
+Randen<uint32_t>& Engine() { return thread_engine.Get(); }
+
+}  // namespace
+}  // namespace randen
+
+// The library is compiled with -fvisibility=hidden; these are its only
+// exports.
+#define RANDEN_EXPORT __attribute__((visibility("default")))
+
+// noexcept matches the glibc declarations (__THROW).
+extern "C" {
+
+RANDEN_EXPORT uint32_t arc4random() noexcept { return randen::Engine()(); }
+
+RANDEN_EXPORT void arc4random_buf(void* buf, size_t size) noexcept {
+  randen::Engine().Fill(buf, size);
+}
+
+// Unbiased: multiplies and rejects the few products whose low half is below
+// 2^32 % upper_bound (Lemire, "Fast Random Integer Generation in an Interval").
+RANDEN_EXPORT uint32_t arc4random_uniform(uint32_t upper_bound) noexcept {
+  if (upper_bound < 2) return 0;
+  randen::Randen<uint32_t>& engine = randen::Engine();
+  uint64_t product = static_cast<uint64_t>(engine()) * upper_bound;
+  uint32_t low = static_cast<uint32_t>(product);
+  if (low < upper_bound) {
+    const uint32_t threshold = (0u - upper_bound) % upper_bound;
+    while (low < threshold) {
+      product = static_cast<uint64_t>(engine()) * upper_bound;
+      low = static_cast<uint32_t>(product);
+    }
+  }
+  return static_cast<uint32_t>(product >> 32);
+}
+
+}  // extern "C"
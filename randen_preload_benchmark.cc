@@ -0,0 +1,180 @@
+// Copyright 2018 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Compares lib/libranden_preload.so with the libc arc4random functions
+// (glibc >= 2.36, which calls getrandom for every request). The library
+// is loaded with RTLD_LOCAL so that it does not interpose on libc.
+
+#include <dlfcn.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+
+#include "nanobenchmark.h"
+
+namespace randen {
+namespace {
+
+struct Functions {
+  uint32_t (*random)();
+  void (*buf)(void*, size_t);
+  uint32_t (*uniform)(uint32_t);
+};
+
+// Returns false if any are missing.
+bool Lookup(void* handle, Functions* functions) {
+  functions->random =
+      reinterpret_cast<uint32_t (*)()>(dlsym(handle, "arc4random"));
+  functions->buf = reinterpret_cast<void (*)(void*, size_t)>(
+      dlsym(handle, "arc4random_buf"));
+  functions->uniform = reinterpret_cast<uint32_t (*)(uint32_t)>(
+      dlsym(handle, "arc4random_uniform"));
+  return functions->random != nullptr && functions->buf != nullptr &&
+         functions->uniform != nullptr;
+}
+
+// lib/ is a sibling of the directory containing this binary.
+std::string DefaultLibraryPath() {
+  char exe[PATH_MAX];
+  const ssize_t len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+  if (len <= 0) return "lib/libranden_preload.so";
+  exe[len] = '\0';
+  std::string path(exe);
+  path.resize(path.rfind('/') + 1);
+  return path + "../lib/libranden_preload.so";
+}
+
+// Returns ticks per call of "closure" (which makes "calls" calls), or a
+// negative value if the measurement failed.
+template <class Closure>
+double TicksPerCall(const Closure& closure, const FuncInput calls) {
+  const FuncInput inputs[1] = {calls};
+  Result results[1];
+  Params p;
+  p.verbose = false;
+  // Retry because interruptions occasionally disturb the overhead estimate.
+  for (int attempt = 0; attempt < 3; ++attempt) {
+    if (MeasureClosure(closure, inputs, 1, results, p) == 1) {
+      return results[0].ticks / calls;
+    }
+  }
+  return -1.0;
+}
+
+alignas(64) uint8_t buffer[4096];
+
+// Ticks per call of each function.
+struct Ticks {
+  double random;
+  double buf16;
+  double buf4096;
+  double uniform;
+};
+
+Ticks Measure(const Functions& f) {
+  constexpr FuncInput kCalls = 64;
+  Ticks ticks;
+  ticks.random = TicksPerCall(
+      [&f](const FuncInput calls) {
+        uint32_t sum = 0;
+        for (FuncInput i = 0; i < calls; ++i) {
+          sum += f.random();
+        }
+        return static_cast<FuncOutput>(sum);
+      },
+      kCalls);
+  ticks.buf16 = TicksPerCall(
+      [&f](const FuncInput calls) {
+        for (FuncInput i = 0; i < calls; ++i) {
+          f.buf(buffer, 16);
+        }
+        return static_cast<FuncOutput>(buffer[0]);
+      },
+      kCalls);
+  ticks.buf4096 = TicksPerCall(
+      [&f](const FuncInput calls) {
+        for (FuncInput i = 0; i < calls; ++i) {
+          f.buf(buffer, sizeof(buffer));
+        }
+        return static_cast<FuncOutput>(buffer[0]);
+      },
+      kCalls / 8);
+  ticks.uniform = TicksPerCall(
+      [&f](const FuncInput calls) {
+        uint32_t sum = 0;
+        for (FuncInput i = 0; i < calls; ++i) {
+          sum += f.uniform(1000 + static_cast<uint32_t>(i));
+        }
+        return static_cast<FuncOutput>(sum);
+      },
+      kCalls);
+  return ticks;
+}
+
+void PrintRow(const char* caption, const double libc, const double randen) {
+  printf("%-20s", caption);
+  if (libc >= 0.0) {
+    printf(" %9.1f", libc);
+  } else {
+    printf(" %9s", "-");
+  }
+  printf(" %9.1f", randen);
+  if (libc > 0.0 && randen > 0.0) {
+    printf(" %8.1fx", libc / randen);
+  }
+  printf("\n");
+}
+
+int RunAll(int argc, char* argv[]) {
+  if (argc > 2) {
+    fprintf(stderr, "Usage: %s [path/to/libranden_preload.so]\n", argv[0]);
+    return 1;
+  }
+  const std::string path = argc == 2 ? argv[1] : DefaultLibraryPath();
+  void* handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+  Functions randen;
+  if (handle == nullptr || !Lookup(handle, &randen)) {
+    fprintf(stderr, "Cannot load %s: %s\n", path.c_str(), dlerror());
+    return 1;
+  }
+
+  // Avoid migrating between cores - important on multi-socket systems.
+  platform::PinThreadToCPU();
+
+  Functions libc;
+  const bool have_libc = Lookup(RTLD_DEFAULT, &libc);
+  Ticks libc_ticks = {-1.0, -1.0, -1.0, -1.0};
+  if (have_libc) {
+    libc_ticks = Measure(libc);
+  } else {
+    printf("libc does not provide arc4random (requires glibc >= 2.36).\n");
+  }
+  const Ticks randen_ticks = Measure(randen);
+
+  printf("%-20s %9s %9s  (ticks per call)\n", "Function", "libc", "Randen");
+  PrintRow("arc4random", libc_ticks.random, randen_ticks.random);
+  PrintRow("arc4random_buf(16)", libc_ticks.buf16, randen_ticks.buf16);
+  PrintRow("arc4random_buf(4096)", libc_ticks.buf4096, randen_ticks.buf4096);
+  PrintRow("arc4random_uniform", libc_ticks.uniform, randen_ticks.uniform);
+  return 0;
+}
+
+}  // namespace
+}  // namespace randen
+
+int main(int argc, char* argv[]) { return randen::RunAll(argc, argv); }
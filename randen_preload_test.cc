@@ -0,0 +1,149 @@
+// Copyright 2018 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Linked against lib/libranden_preload.so, whose definitions therefore take
+// precedence over any in libc (as with LD_PRELOAD).
+
+#include <dlfcn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <thread>
+
+// Declared by glibc >= 2.36, but not earlier.
+extern "C" {
+uint32_t arc4random() noexcept;
+void arc4random_buf(void* buf, size_t size) noexcept;
+uint32_t arc4random_uniform(uint32_t upper_bound) noexcept;
+}
+
+namespace randen {
+namespace {
+
+#define STR(x) #x
+
+#define ASSERT_TRUE(condition)                                                \
+  do {                                                                        \
+    if (!(condition)) {                                                       \
+      printf("Assertion [" STR(condition) "] failed on line %d\n", __LINE__); \
+      abort();                                                                \
+    }                                                                         \
+  } while (false)
+
+// (&arc4random may refer to a PLT entry in this executable.)
+void VerifyResolvedToLibrary() {
+  void* address = dlsym(RTLD_DEFAULT, "arc4random");
+  ASSERT_TRUE(address != nullptr);
+  Dl_info info;
+  ASSERT_TRUE(dladdr(address, &info) != 0);
+  ASSERT_TRUE(strstr(info.dli_fname, "libranden_preload") != nullptr);
+}
+
+void VerifyBuf() {
+  // Odd sizes and offsets exercise Fill's partial values.
+  uint8_t buf1[1001] = {0};
+  uint8_t buf2[1001] = {0};
+  arc4random_buf(buf1 + 1, 999);
+  arc4random_buf(buf2 + 1, 999);
+  ASSERT_TRUE(buf1[0] == 0 && buf1[1000] == 0);
+  ASSERT_TRUE(memcmp(buf1, buf2, sizeof(buf1)) != 0);
+
+  size_t num_zero = 0;
+  for (size_t i = 1; i < 1000; ++i) {
+    num_zero += buf1[i] == 0;
+  }
+  ASSERT_TRUE(num_zero < 20);  // expected: 4
+}
+
+void VerifyUniform() {
+  ASSERT_TRUE(arc4random_uniform(0) == 0);
+  ASSERT_TRUE(arc4random_uniform(1) == 0);
+
+  // All values occur, and none out of bounds.
+  const uint32_t kBound = 10;
+  size_t counts[kBound] = {0};
+  for (int i = 0; i < 10000; ++i) {
+    const uint32_t value = arc4random_uniform(kBound);
+    ASSERT_TRUE(value < kBound);
+    counts[value]++;
+  }
+  for (size_t count : counts) {
+    ASSERT_TRUE(800 < count && count < 1200);
+  }
+
+  // Large bound with a high rejection rate.
+  const uint32_t kLarge = 0x80000001u;
+  for (int i = 0; i < 1000; ++i) {
+    ASSERT_TRUE(arc4random_uniform(kLarge) < kLarge);
+  }
+}
+
+// Each thread has its own engine, seeded independently.
+void VerifyThreads() {
+  uint32_t values[2][4];
+  for (int t = 0; t < 2; ++t) {
+    std::thread([&values, t]() {
+      for (uint32_t& value : values[t]) {
+        value = arc4random();
+      }
+    }).join();
+  }
+  ASSERT_TRUE(memcmp(values[0], values[1], sizeof(values[0])) != 0);
+}
+
+// The child must not repeat the parent's output.
+void VerifyFork() {
+  (void)arc4random();  // ensure the parent's engine is seeded
+
+  int fds[2];
+  ASSERT_TRUE(pipe(fds) == 0);
+  const pid_t pid = fork();
+  ASSERT_TRUE(pid >= 0);
+  uint32_t values[8];
+  if (pid == 0) {
+    arc4random_buf(values, sizeof(values));
+    const bool ok = write(fds[1], values, sizeof(values)) == sizeof(values);
+    _exit(ok ? 0 : 1);
+  }
+
+  arc4random_buf(values, sizeof(values));
+  uint32_t child_values[8];
+  ASSERT_TRUE(read(fds[0], child_values, sizeof(child_values)) ==
+              sizeof(child_values));
+  int status;
+  ASSERT_TRUE(waitpid(pid, &status, 0) == pid);
+  ASSERT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  ASSERT_TRUE(memcmp(values, child_values, sizeof(values)) != 0);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+void RunAll() {
+  VerifyResolvedToLibrary();
+  VerifyBuf();
+  VerifyUniform();
+  VerifyThreads();
+  VerifyFork();
+}
+
+}  // namespace
+}  // namespace randen
+
+int main(int argc, char* argv[]) {
+  randen::RunAll();
+  return 0;
+}
@@ -0,0 +1,131 @@
+// Copyright 2018 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "randen_ring.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <new>
+
+#include "nanobenchmark.h"
+#include "randen.h"
+#include "randen_getrandom.h"
+
+namespace randen {
+namespace {
+
+constexpr size_t kStateLanes = Internal::kStateBytes / sizeof(uint64_t);
+constexpr size_t kCapacityLanes = Internal::kCapacityBytes / sizeof(uint64_t);
+static_assert(kStateLanes - kCapacityLanes == RandenRing::kBlockLanes,
+              "Block must be the rate part of the state");
+
+// Waits increasingly long: spinning suits short waits for other CPUs, yielding
+// lets threads sharing the CPU make progress, and sleeping avoids burning a
+// CPU while the ring remains full (or empty).
+class Backoff {
+ public:
+  void Wait() {
+    if (count_ < kSpins) {
+#if defined(__x86_64__) || defined(__i386__)
+      __builtin_ia32_pause();
+#endif
+    } else if (count_ < kSpins + kYields) {
+      std::this_thread::yield();
+    } else {
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+    ++count_;
+  }
+
+ private:
+  static constexpr int kSpins = 64;
+  static constexpr int kYields = 64;
+  int count_ = 0;
+};
+
+}  // namespace
+
+RandenRing::RandenRing(const std::vector<int>& producer_cpus,
+                       const size_t num_blocks)
+    : num_blocks_(2) {
+  while (num_blocks_ < num_blocks) {
+    num_blocks_ *= 2;
+  }
+  void* allocated;
+  if (posix_memalign(&allocated, alignof(Slot), num_blocks_ * sizeof(Slot))) {
+    throw std::bad_alloc();
+  }
+  slots_ = static_cast<Slot*>(allocated);
+  for (size_t i = 0; i < num_blocks_; ++i) {
+    new (&slots_[i].sequence) std::atomic<uint64_t>(i);
+  }
+
+  try {
+    for (const int cpu : producer_cpus) {
+      producers_.emplace_back(&RandenRing::Produce, this, cpu);
+    }
+  } catch (...) {
+    Stop();
+    throw;
+  }
+}
+
+RandenRing::~RandenRing() { Stop(); }
+
+void RandenRing::Stop() {
+  stop_.store(true, std::memory_order_relaxed);
+  for (std::thread& producer : producers_) {
+    producer.join();
+  }
+  free(slots_);
+}
+
+void RandenRing::Produce(const int cpu) {
+  platform::PinThreadToCPU(cpu);
+  alignas(32) uint64_t state[kStateLanes];
+  SeedState(state);
+
+  while (!stop_.load(std::memory_order_relaxed)) {
+    // Before claiming a slot, so consumers do not wait for it.
+    Internal::Generate(state);
+
+    const uint64_t ticket =
+        produce_ticket_.fetch_add(1, std::memory_order_relaxed);
+    Slot& slot = slots_[ticket & (num_blocks_ - 1)];
+    // Wait until the previous consumer of the slot has copied it.
+    Backoff backoff;
+    while (slot.sequence.load(std::memory_order_acquire) != ticket) {
+      if (stop_.load(std::memory_order_relaxed)) return;
+      backoff.Wait();
+    }
+    memcpy(slot.block.lanes, state + kCapacityLanes, sizeof(Block));
+    slot.sequence.store(ticket + 1, std::memory_order_release);
+  }
+}
+
+void RandenRing::Take(Block* block) {
+  const uint64_t ticket =
+      consume_ticket_.fetch_add(1, std::memory_order_relaxed);
+  Slot& slot = slots_[ticket & (num_blocks_ - 1)];
+  Backoff backoff;
+  while (slot.sequence.load(std::memory_order_acquire) != ticket + 1) {
+    backoff.Wait();
+  }
+  memcpy(block, &slot.block, sizeof(Block));
+  // Free for the producer in the next round.
+  slot.sequence.store(ticket + num_blocks_, std::memory_order_release);
+}
+
+}  // namespace randen
@@ -0,0 +1,133 @@
+// Copyright 2018 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Randen output generated ahead of time by dedicated producer threads.
+
+#ifndef RANDEN_RING_H_
+#define RANDEN_RING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <limits>
+#include <thread>
+#include <vector>
+
+namespace randen {
+
+// Bounded blocking MPMC ring of 240-byte blocks (the rate part of one Randen
+// state after Generate), filled by producer threads pinned to the given CPUs
+// and consumed by any number of threads. Producers and consumers each take a
+// ticket with a single fetch_add and then wait for the corresponding slot:
+// producers until its previous block was consumed (backpressure), consumers
+// until it was filled. This is not lock-free: a consumer waits for the
+// producer holding the matching ticket, even if that producer is descheduled
+// and other blocks are ready. Moves the cost of Generate off latency-critical
+// threads, at the cost of dedicated CPUs and a copy.
+//
+// Blocks are seeded via getrandom and not reproducible. Each block is
+// returned exactly once, in no particular order across consumers. Not safe
+// across fork (producer threads do not exist in the child).
+class RandenRing {
+ public:
+  static constexpr size_t kBlockLanes = 30;
+
+  struct Block {
+    uint64_t lanes[kBlockLanes];
+  };
+
+  // Starts one producer per entry of "producer_cpus", pinned to that CPU as
+  // platform::PinThreadToCPU (negative: the CPU it starts on). "num_blocks" is
+  // rounded up to a power of two. Take waits forever if "producer_cpus" is
+  // empty. Throws std::bad_alloc.
+  RandenRing(const std::vector<int>& producer_cpus, size_t num_blocks = 1024);
+
+  // Stops the producers. Requires that no consumer is in Take: consumers do
+  // not check for shutdown, so an outstanding Take would never return.
+  ~RandenRing();
+
+  RandenRing(const RandenRing&) = delete;
+  RandenRing& operator=(const RandenRing&) = delete;
+
+  // Copies the next block to "block", waiting for producers if necessary.
+  // Thread-safe.
+  void Take(Block* block);
+
+  // Returns the number of blocks generated so far. Because producers stall
+  // while the ring is full, this is at most the number of blocks taken plus
+  // NumBlocks() plus the number of producers.
+  uint64_t NumProduced() const {
+    return produce_ticket_.load(std::memory_order_relaxed);
+  }
+
+  size_t NumBlocks() const { return num_blocks_; }
+
+  // URBG returning the values of one block at a time. Thread-compatible; use
+  // one per consumer thread.
+  class Engine {
+   public:
+    using result_type = uint64_t;
+
+    explicit Engine(RandenRing* ring) : ring_(ring) {}
+
+    static constexpr result_type min() {
+      return std::numeric_limits<result_type>::min();
+    }
+
+    static constexpr result_type max() {
+      return std::numeric_limits<result_type>::max();
+    }
+
+    result_type operator()() {
+      if (next_ >= kBlockLanes) {
+        ring_->Take(&block_);
+        next_ = 0;
+      }
+      return block_.lanes[next_++];
+    }
+
+   private:
+    RandenRing* ring_;
+    size_t next_ = kBlockLanes;
+    Block block_;
+  };
+
+ private:
+  // A block is ready for the consumer with ticket t when sequence is t + 1,
+  // and free for the producer with ticket t when sequence is t.
+  struct alignas(64) Slot {
+    std::atomic<uint64_t> sequence;
+    Block block;
+  };
+  static_assert(sizeof(Slot) == 256, "Slot should be four cache lines");
+
+  void Produce(int cpu);
+
+  // Joins the producers and frees the slots.
+  void Stop();
+
+  Slot* slots_;  // owned, num_blocks_
+  size_t num_blocks_;
+
+  // Separate cache lines avoid false sharing between producers, consumers
+  // and the read-only members above.
+  alignas(64) std::atomic<uint64_t> produce_ticket_{0};
+  alignas(64) std::atomic<uint64_t> consume_ticket_{0};
+  alignas(64) std::atomic<bool> stop_{false};
+  std::vector<std::thread> producers_;
+};
+
+}  // namespace randen
+
+#endif  // RANDEN_RING_H_
@@ -0,0 +1,147 @@
+// Copyright 2018 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Compares RandenRing::Take with generating the block in the consumer thread:
+// latency percentiles of each call and aggregate throughput, for 1, 2 and 4
+// consumers. Producers are pinned to the last CPUs.
+// Usage: randen_ring_benchmark [producers]
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "nanobenchmark.h"
+#include "randen.h"
+#include "randen_ring.h"
+#include "timer.h"
+
+namespace randen {
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t kBlocksPerConsumer = 100000;
+constexpr size_t kStateLanes = Internal::kStateBytes / sizeof(uint64_t);
+constexpr size_t kCapacityLanes = Internal::kCapacityBytes / sizeof(uint64_t);
+
+// Obtains blocks in the consumer thread, as RandenRing's producers do.
+class InThread {
+ public:
+  explicit InThread(const uint64_t seed) {
+    std::fill(state_, state_ + kStateLanes, seed);
+  }
+
+  void Take(RandenRing::Block* block) {
+    Internal::Generate(state_);
+    memcpy(block, state_ + kCapacityLanes, sizeof(*block));
+  }
+
+ private:
+  alignas(32) uint64_t state_[kStateLanes];
+};
+
+// Runs "num_consumers" threads that each call take(consumer_index, block)
+// kBlocksPerConsumer times, and prints latency and throughput.
+template <class Take>
+void Run(const char* caption, const size_t num_consumers, const Take& take) {
+  std::vector<std::vector<uint64_t>> ticks(num_consumers);
+  std::vector<std::thread> consumers;
+  const Clock::time_point begin = Clock::now();
+  for (size_t c = 0; c < num_consumers; ++c) {
+    consumers.emplace_back([&ticks, &take, c]() {
+      std::vector<uint64_t>& my_ticks = ticks[c];
+      my_ticks.reserve(kBlocksPerConsumer);
+      RandenRing::Block block;
+      uint64_t sum = 0;
+      for (size_t i = 0; i < kBlocksPerConsumer; ++i) {
+        const uint64_t t0 = timer::Start64();
+        take(c, &block);
+        const uint64_t t1 = timer::Stop64();
+        sum += block.lanes[0];
+        my_ticks.push_back(t1 - t0);
+      }
+      PreventElision(sum);
+    });
+  }
+  for (std::thread& consumer : consumers) {
+    consumer.join();
+  }
+  const double seconds =
+      std::chrono::duration<double>(Clock::now() - begin).count();
+
+  std::vector<uint64_t> all;
+  for (const std::vector<uint64_t>& my_ticks : ticks) {
+    all.insert(all.end(), my_ticks.begin(), my_ticks.end());
+  }
+  std::sort(all.begin(), all.end());
+  static const double ns_per_tick = 1E9 / platform::InvariantTicksPerSecond();
+  const auto percentile = [&all](const double p) {
+    return ns_per_tick * all[static_cast<size_t>(p * (all.size() - 1))];
+  };
+  const double bytes =
+      static_cast<double>(all.size()) * sizeof(RandenRing::Block);
+  printf("%-9s %9zu %8.0f %8.0f %10.0f %9.0f\n", caption, num_consumers,
+         percentile(0.5), percentile(0.99), percentile(1.0),
+         bytes / seconds * 1E-6);
+}
+
+void RunAll(const size_t num_producers) {
+  const long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  std::vector<int> cpus;
+  for (size_t p = 0; p < num_producers; ++p) {
+    cpus.push_back(static_cast<int>((num_cpus - 1 - p) % num_cpus));
+  }
+  printf("%zu producers, %ld CPUs\n", num_producers, num_cpus);
+  printf("%-9s %9s %8s %8s %10s %9s\n", "Source", "Consumers", "p50 ns",
+         "p99 ns", "max ns", "MB/s");
+
+  for (const size_t num_consumers : {1, 2, 4}) {
+    std::vector<InThread> generators;
+    for (size_t c = 0; c < num_consumers; ++c) {
+      generators.emplace_back(c);
+    }
+    Run("in-thread", num_consumers,
+        [&generators](const size_t c, RandenRing::Block* block) {
+          generators[c].Take(block);
+        });
+
+    RandenRing ring(cpus);
+    // Let the producers fill the ring.
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    Run("ring", num_consumers,
+        [&ring](const size_t c, RandenRing::Block* block) {
+          ring.Take(block);
+        });
+  }
+}
+
+}  // namespace
+}  // namespace randen
+
+int main(int argc, char* argv[]) {
+  const size_t num_producers = (argc > 1) ? strtoull(argv[1], nullptr, 10) : 1;
+  // Otherwise Take would wait forever.
+  if (num_producers == 0) {
+    fprintf(stderr, "Usage: %s [num_producers >= 1]\n", argv[0]);
+    return 1;
+  }
+  randen::RunAll(num_producers);
+  return 0;
+}
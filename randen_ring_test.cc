@@ -0,0 +1,111 @@
+// Copyright 2018 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "randen_ring.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace randen {
+namespace {
+
+#define STR(x) #x
+
+#define ASSERT_TRUE(condition)                                                \
+  do {                                                                        \
+    if (!(condition)) {                                                       \
+      printf("Assertion [" STR(condition) "] failed on line %d\n", __LINE__); \
+      abort();                                                                \
+    }                                                                         \
+  } while (false)
+
+// Every block is taken exactly once, even with several producers and more
+// consumers than slots.
+void VerifyUnique() {
+  constexpr size_t kConsumers = 4;
+  constexpr size_t kBlocksPerConsumer = 5000;
+  RandenRing ring({-1, -1}, 8);
+  std::vector<uint64_t> first_lanes(kConsumers * kBlocksPerConsumer);
+  std::vector<std::thread> consumers;
+  for (size_t c = 0; c < kConsumers; ++c) {
+    consumers.emplace_back([&ring, &first_lanes, c]() {
+      RandenRing::Block block;
+      for (size_t i = 0; i < kBlocksPerConsumer; ++i) {
+        ring.Take(&block);
+        // Distinct lanes within the block: it was fully written.
+        std::sort(block.lanes, block.lanes + RandenRing::kBlockLanes);
+        ASSERT_TRUE(std::adjacent_find(
+                        block.lanes, block.lanes + RandenRing::kBlockLanes) ==
+                    block.lanes + RandenRing::kBlockLanes);
+        first_lanes[c * kBlocksPerConsumer + i] = block.lanes[0];
+      }
+    });
+  }
+  for (std::thread& consumer : consumers) {
+    consumer.join();
+  }
+  std::sort(first_lanes.begin(), first_lanes.end());
+  ASSERT_TRUE(std::adjacent_find(first_lanes.begin(), first_lanes.end()) ==
+              first_lanes.end());
+}
+
+// Producers wait while the ring is full, and still stop when destroyed.
+void VerifyBackpressure() {
+  constexpr uint64_t kProducers = 1;
+  RandenRing ring({-1}, 4);
+  ASSERT_TRUE(ring.NumBlocks() == 4);
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  ASSERT_TRUE(ring.NumProduced() <= 4 + kProducers);
+
+  constexpr uint64_t kTaken = 100;
+  RandenRing::Block block;
+  for (uint64_t i = 0; i < kTaken; ++i) {
+    ring.Take(&block);
+  }
+  ASSERT_TRUE(ring.NumProduced() >= kTaken);
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  ASSERT_TRUE(ring.NumProduced() <= kTaken + 4 + kProducers);
+}
+
+void VerifyEngine() {
+  RandenRing ring({-1});
+  RandenRing::Engine engine(&ring);
+  std::uniform_int_distribution<uint32_t> dist(0, 9);
+  size_t counts[10] = {0};
+  for (int i = 0; i < 100000; ++i) {
+    ++counts[dist(engine)];
+  }
+  for (const size_t count : counts) {
+    ASSERT_TRUE(9000 < count && count < 11000);
+  }
+}
+
+void RunAll() {
+  VerifyUnique();
+  VerifyBackpressure();
+  VerifyEngine();
+}
+
+}  // namespace
+}  // namespace randen
+
+int main(int argc, char* argv[]) {
+  randen::RunAll();
+  return 0;
+}
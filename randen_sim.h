@@ -0,0 +1,78 @@
+// Copyright 2018 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// NOT FOR CRYPTOGRAPHIC USE: Randen with fewer Feistel rounds, for
+// simulations that only require statistical quality. The 17 rounds of Randen
+// are needed for its security argument; there is none for fewer rounds, so
+// outputs may be predictable and backtracking resistance is lost.
+//
+// Each round costs the same, so throughput of the refill scales with
+// 17 / kRounds. After 8 rounds, each output block depends on all input blocks
+// (one full subblock diffusion of the 16-branch shuffle); with fewer rounds,
+// diffusion within one buffer is incomplete and only the chaining of the state
+// across buffers mixes the remaining blocks. See README.md for test results.
+//
+// Uses the inline permutation, so users require the same target flags (e.g.
+// -maes) as randen.cc, but do not need to link it.
+
+#ifndef RANDEN_SIM_H_
+#define RANDEN_SIM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "randen.h"
+#include "randen_inl.h"
+
+namespace randen {
+
+// Sponge policy for Randen with "kRounds" of the Feistel network.
+template <int kRounds>
+struct RandenSimSponge {
+  static_assert(1 <= kRounds && kRounds < Internal::kRounds,
+                "Use Randen for the full number of rounds");
+
+  static constexpr int kBufferBytes = Internal::kStateBytes;
+
+  template <typename T, size_t N>
+  static void Absorb(const void* seed, T (&state)[N]) {
+    inl::Absorb(static_cast<const uint64_t*>(seed), inl::Lanes(state));
+  }
+
+  template <typename T, size_t N>
+  static void Generate(T (&state)[N]) {
+    inl::Generate<kRounds>(inl::Lanes(state));
+  }
+
+  template <typename T, size_t N>
+  static void Generate2(T (&state0)[N], T (&state1)[N]) {
+    inl::Generate2<kRounds>(inl::Lanes(state0), inl::Lanes(state1));
+  }
+
+  template <typename T, size_t N>
+  static void GenerateStream(T (&state)[N], void* out,
+                             const size_t num_buffers) {
+    inl::GenerateStream<kRounds>(inl::Lanes(state),
+                                 static_cast<uint64_t*>(out), num_buffers);
+  }
+};
+
+// Same interface as Randen<T>, e.g. RandenSim<uint64_t, 8>. RANDEN_STATS
+// counts its bytes served, but not its refills.
+template <typename T, int kRounds>
+using RandenSim = Randen<T, RandenSimSponge<kRounds>>;
+
+}  // namespace randen
+
+#endif  // RANDEN_SIM_H_
@@ -0,0 +1,300 @@
+// Copyright 2018 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Writes raw generator output to stdout or a file at full speed, e.g. for
+// statistical test batteries: bin/randen_stream | RNG_test stdin64
+
+#include "engine_registry.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <type_traits>
+
+#ifdef __linux__
+#include <sys/uio.h>  // vmsplice
+#endif
+
+#include "vector128.h"  // RANDEN_RESTRICT
+
+namespace randen {
+namespace {
+
+struct Options {
+  Selection engine{"Randen"};
+  bool seeded = false;
+  uint64_t seed = 0;
+  uint64_t max_bytes = ~0ull;  // unlimited
+  const char* path = nullptr;  // stdout
+};
+
+// For write(): large enough to amortize the syscall.
+constexpr size_t kWriteBytes = size_t{4} << 20;
+
+// Zero-copy output to a pipe: vmsplice only references the pages, so a buffer
+// must not be refilled until the reader has consumed it. Once a chunk of half
+// the pipe capacity has been spliced, the pipe holds at most that chunk and
+// the previous one, so the one before that is free: we rotate three chunks.
+constexpr size_t kSpliceChunks = 3;
+constexpr int kPipeBytes = 1 << 20;  // default /proc/sys/fs/pipe-max-size
+
+// Returns the chunk size for vmsplice, or zero if "fd" is not a pipe.
+size_t SpliceChunkBytes(const int fd) {
+#ifdef __linux__
+  struct stat info;
+  if (fstat(fd, &info) != 0 || !S_ISFIFO(info.st_mode)) return 0;
+  (void)fcntl(fd, F_SETPIPE_SZ, kPipeBytes);  // may fail; keep the default
+  const int capacity = fcntl(fd, F_GETPIPE_SZ);
+  if (capacity < 8192) return 0;
+  return static_cast<size_t>(capacity) / 2;
+#else
+  return 0;
+#endif
+}
+
+// Returns false (with errno set) on error.
+bool SpliceAll(const int fd, const uint8_t* bytes, size_t size) {
+#ifdef __linux__
+  while (size != 0) {
+    iovec iov;
+    iov.iov_base = const_cast<uint8_t*>(bytes);
+    iov.iov_len = size;
+    const ssize_t ret = vmsplice(fd, &iov, 1, 0);
+    if (ret < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    bytes += ret;
+    size -= ret;
+  }
+  return true;
+#else
+  errno = ENOSYS;
+  return false;
+#endif
+}
+
+bool WriteAll(const int fd, const uint8_t* bytes, size_t size) {
+  while (size != 0) {
+    const ssize_t ret = write(fd, bytes, size);
+    if (ret < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    bytes += ret;
+    size -= ret;
+  }
+  return true;
+}
+
+// "restrict" allows keeping the engine's buffer index in a register.
+template <class Engine>
+void Fill(Engine& engine, uint64_t* RANDEN_RESTRICT words,
+          const size_t num_words) {
+  for (size_t i = 0; i < num_words; ++i) {
+    words[i] = engine();
+  }
+}
+
+template <class Engine>
+int Stream(Engine& engine, const uint64_t max_bytes, const int fd) {
+  static_assert(sizeof(engine()) == sizeof(uint64_t), "Expected u64 engine");
+  const size_t chunk_bytes = SpliceChunkBytes(fd);
+  const bool splice = chunk_bytes != 0;
+  const size_t num_chunks = splice ? kSpliceChunks : 1;
+  const size_t buffer_bytes = splice ? chunk_bytes : kWriteBytes;
+
+  // Page-aligned so that vmsplice does not reference unrelated data.
+  void* allocated = nullptr;
+  if (posix_memalign(&allocated, 4096, num_chunks * buffer_bytes) != 0) {
+    fprintf(stderr, "Allocation failed\n");
+    return 1;
+  }
+  uint64_t* words = static_cast<uint64_t*>(allocated);
+  const size_t words_per_buffer = buffer_bytes / sizeof(uint64_t);
+
+  int ret = 0;
+  uint64_t remaining = max_bytes;
+  for (size_t chunk = 0; remaining != 0; chunk = (chunk + 1) % num_chunks) {
+    uint64_t* buffer = words + chunk * words_per_buffer;
+    const size_t bytes =
+        static_cast<size_t>(std::min<uint64_t>(buffer_bytes, remaining));
+    const size_t num_words = (bytes + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+    Fill(engine, buffer, num_words);
+
+    const uint8_t* bytes8 = reinterpret_cast<const uint8_t*>(buffer);
+    if (!(splice ? SpliceAll(fd, bytes8, bytes)
+                 : WriteAll(fd, bytes8, bytes))) {
+      // The reader exiting (e.g. after its tests) is not an error.
+      if (errno != EPIPE) {
+        perror("randen_stream");
+        ret = 1;
+      }
+      break;
+    }
+    remaining -= bytes;
+  }
+
+  free(allocated);
+  return ret;
+}
+
+// Constructs the engine from the seed if requested and supported.
+template <class Engine>
+int StreamEngine(const Options& options, const int fd, std::true_type) {
+  if (!options.seeded) {
+    Engine engine;
+    return Stream(engine, options.max_bytes, fd);
+  }
+  Engine engine(options.seed);
+  return Stream(engine, options.max_bytes, fd);
+}
+
+template <class Engine>
+int StreamEngine(const Options& options, const int fd, std::false_type) {
+  if (options.seeded) return -1;
+  Engine engine;
+  return Stream(engine, options.max_bytes, fd);
+}
+
+// Counts the selected engines, which must be exactly one.
+class VisitorCount : public EngineVisitor {
+ public:
+  template <class Engine>
+  void Visit(const char* caption) {
+    ++count_;
+  }
+  void Unsupported(const char* caption) { ++count_; }
+
+  size_t Count() const { return count_; }
+
+ private:
+  size_t count_ = 0;
+};
+
+class VisitorStream : public EngineVisitor {
+ public:
+  VisitorStream(const Options& options, const int fd)
+      : options_(options), fd_(fd) {}
+
+  template <class Engine>
+  void Visit(const char* caption) {
+    result_ = StreamEngine<Engine>(
+        options_, fd_, std::is_constructible<Engine, uint64_t>());
+    if (result_ == -1) {
+      fprintf(stderr, "%s cannot be seeded\n", caption);
+      result_ = 1;
+    }
+  }
+
+  void Unsupported(const char* caption) {
+    fprintf(stderr, "%s: not supported by this CPU\n", caption);
+  }
+
+  int Result() const { return result_; }
+
+ private:
+  const Options& options_;
+  const int fd_;
+  int result_ = 1;
+};
+
+// Accepts K/M/G (binary) suffixes.
+bool ParseBytes(const char* str, uint64_t* bytes) {
+  char* end;
+  *bytes = strtoull(str, &end, 0);
+  if (end == str) return false;
+  switch (*end) {
+    case '\0':
+      return true;
+    case 'K':
+      *bytes <<= 10;
+      break;
+    case 'M':
+      *bytes <<= 20;
+      break;
+    case 'G':
+      *bytes <<= 30;
+      break;
+    default:
+      return false;
+  }
+  return end[1] == '\0';
+}
+
+int Usage(const char* program) {
+  fprintf(stderr,
+          "Usage: %s [--engine=NAME] [--seed=N] [--bytes=N[K|M|G]] "
+          "[--out=PATH]\n"
+          "Writes unlimited bytes of Randen output to stdout by default.\n",
+          program);
+  return 1;
+}
+
+int RunAll(int argc, char* argv[]) {
+  Options options;
+  for (int i = 1; i < argc; ++i) {
+    if (!strncmp(argv[i], "--engine=", 9)) {
+      options.engine = Selection(argv[i] + 9);
+    } else if (!strncmp(argv[i], "--seed=", 7)) {
+      options.seeded = true;
+      options.seed = strtoull(argv[i] + 7, nullptr, 0);
+    } else if (!strncmp(argv[i], "--bytes=", 8)) {
+      if (!ParseBytes(argv[i] + 8, &options.max_bytes)) return Usage(argv[0]);
+    } else if (!strncmp(argv[i], "--out=", 6)) {
+      options.path = argv[i] + 6;
+    } else {
+      return Usage(argv[0]);
+    }
+  }
+
+  VisitorCount count;
+  ForeachEngine(options.engine, count);
+  if (count.Count() != 1) {
+    fprintf(stderr, "--engine must select exactly one of the engines listed "
+                    "by randen_benchmark --list.\n");
+    return 1;
+  }
+
+  int fd = STDOUT_FILENO;
+  if (options.path != nullptr) {
+    fd = open(options.path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+      perror(options.path);
+      return 1;
+    }
+  }
+
+  // Report EPIPE instead of terminating, so that we can exit cleanly.
+  signal(SIGPIPE, SIG_IGN);
+
+  VisitorStream visitor(options, fd);
+  ForeachEngine(options.engine, visitor);
+  if (fd != STDOUT_FILENO && close(fd) != 0) {
+    perror(options.path);
+    return 1;
+  }
+  return visitor.Result();
+}
+
+}  // namespace
+}  // namespace randen
+
+int main(int argc, char* argv[]) { return randen::RunAll(argc, argv); }
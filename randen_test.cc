@@ -15,9 +15,17 @@
 #include "randen.h"
 
 #include <stdio.h>
+#include <string.h>
 #include <algorithm>
 #include <random>  // seed_seq
 #include <sstream>
+#if RANDEN_STATS
+#include <new>
+#include <thread>
+#include <type_traits>
+#endif
+
+#include "randen_sim.h"
 
 #define UPDATE_GOLDEN 0
 #define ENABLE_VERIFY 1
@@ -62,6 +70,46 @@ void VerifyReseedChangesAllValues() {
   }
 }
 
+// Fill and FillStream write the same bytes as operator(), for all sizes,
+// destination alignments and positions within the buffer.
+void VerifyFill() {
+  const size_t kMaxBytes = 1000;  // > 4 buffers
+  alignas(16) uint8_t expected[kMaxBytes + 8];
+  alignas(16) uint8_t actual[kMaxBytes + 16];
+  for (int num_used = 0; num_used < 31; num_used += 5) {
+    EngRanden engine_used;
+    for (int i = 0; i < num_used; ++i) {
+      (void)engine_used();
+    }
+
+    for (size_t size = 0; size <= kMaxBytes; size += 37) {
+      EngRanden engine_ref = engine_used;
+      for (size_t i = 0; i < size; i += sizeof(uint64_t)) {
+        const uint64_t value = engine_ref();
+        memcpy(expected + i, &value, sizeof(value));
+      }
+
+      for (size_t offset : {0, 8, 3}) {
+        EngRanden engine_fill = engine_used;
+        engine_fill.Fill(actual + offset, size);
+        ASSERT_TRUE(memcmp(expected, actual + offset, size) == 0);
+        ASSERT_TRUE(engine_fill == engine_ref);
+
+        // Whole buffers after the current one are streamed, also if an odd
+        // number of lanes remain, unless the destination is unaligned.
+        const size_t remaining = (30 - num_used % 30) % 30 * 8;
+        const size_t head = std::min(remaining, size);
+        EngRanden engine_stream = engine_used;
+        const size_t streamed = engine_stream.FillStream(actual + offset, size);
+        ASSERT_TRUE(streamed ==
+                    (offset % 8 == 0 ? (size - head) / 240 * 240 : 0));
+        ASSERT_TRUE(memcmp(expected, actual + offset, size) == 0);
+        ASSERT_TRUE(engine_stream == engine_ref);
+      }
+    }
+  }
+}
+
 void VerifyDiscard() {
   const int N = 56;  // two buffer's worth
   for (int num_used = 0; num_used < N; ++num_used) {
@@ -147,6 +195,209 @@ void VerifyGolden() {
 #endif
 }
 
+// Chaining buffers only changes when the engine refills, not its output
+// (unless reseeded).
+void VerifyChained() {
+  using EngChained = Randen<uint64_t, ChainedSponge<3>>;
+  std::seed_seq seq{1, 2, 3};
+  EngRanden engine1(seq);
+  EngChained engine2(seq);
+  for (size_t i = 0; i < 1000; ++i) {
+    ASSERT_TRUE(engine1() == engine2());
+  }
+
+  engine1.discard(77);
+  engine2.discard(77);
+  ASSERT_TRUE(engine1() == engine2());
+  engine1.discard(1000);
+  engine2.discard(1000);
+  ASSERT_TRUE(engine1() == engine2());
+
+  alignas(16) uint8_t bytes1[3001];
+  alignas(16) uint8_t bytes2[3001];
+  engine1.Fill(bytes1, 33);
+  engine2.Fill(bytes2, 33);
+  engine1.FillStream(bytes1 + 33, 2000);
+  engine2.FillStream(bytes2 + 33, 2000);
+  engine1.Fill(bytes1 + 2033, 968);
+  engine2.Fill(bytes2 + 2033, 968);
+  ASSERT_TRUE(memcmp(bytes1, bytes2, sizeof(bytes1)) == 0);
+  ASSERT_TRUE(engine1() == engine2());
+
+  // Streams whole buffers from the start.
+  EngRanden engine3;
+  EngChained engine4;
+  engine3.FillStream(bytes1, 3000);
+  engine4.FillStream(bytes2, 3000);
+  ASSERT_TRUE(memcmp(bytes1, bytes2, 3000) == 0);
+  ASSERT_TRUE(engine3() == engine4());
+
+  ASSERT_TRUE(sizeof(EngChained) > 3 * 240);
+}
+
+void VerifyForStream() {
+  std::seed_seq seq{4, 5, 6};
+  const EngRanden master(seq);
+  EngRanden copy = master;
+  EngRanden stream = EngRanden::ForStream(master, "user", 42);
+  ASSERT_TRUE(copy == master);  // unchanged
+
+  const uint64_t golden[4] = {0xa23ee7651394b5d3, 0xe52798c7ff37ccca,
+                              0x237d48efd973ae1c, 0x882a8b046b0b21a4};
+  EngRanden unseeded = EngRanden::ForStream(EngRanden(), "user", 42);
+#if UPDATE_GOLDEN
+  for (size_t i = 0; i < 4; ++i) {
+    printf("0x%016lx,\n", unseeded());
+  }
+  printf("\n");
+#else
+  for (size_t i = 0; i < 4; ++i) {
+    ASSERT_TRUE(golden[i] == unseeded());
+  }
+#endif
+
+  // Hierarchical; independent of values already returned from the current
+  // buffer of the parent.
+  EngRanden parent = EngRanden::ForStream(master, "user");
+  for (int i = 0; i < 3; ++i) (void)parent();
+  ASSERT_TRUE(EngRanden::ForStream(parent, 42) == stream);
+  ASSERT_TRUE(EngRanden::ForStream(master, "user", 42u) == stream);
+  ASSERT_TRUE(EngRanden::ForStream(master, std::string("user"), 42) == stream);
+
+  // Distinct paths, including those with the same bytes.
+  const uint8_t bytes42[8] = {42};
+  const EngRanden distinct[] = {
+      master,
+      EngRanden::ForStream(master, "user"),
+      EngRanden::ForStream(master, "user", 43),
+      EngRanden::ForStream(master, 42, "user"),
+      EngRanden::ForStream(master, "use", "r", 42),
+      EngRanden::ForStream(master, "user", StreamKey(bytes42, 8)),
+      EngRanden::ForStream(master, "user", 42, 0),
+      EngRanden::ForStream(master, "user", "")};
+  uint64_t first = stream();
+  for (const EngRanden& other : distinct) {
+    EngRanden engine = other;
+    ASSERT_TRUE(engine() != first);
+  }
+
+  // Keys longer than one block: every byte matters.
+  std::string long_key(500, 'x');
+  first = EngRanden::ForStream(master, long_key)();
+  long_key[499] = 'y';
+  ASSERT_TRUE(EngRanden::ForStream(master, long_key)() != first);
+  long_key.resize(499);
+  ASSERT_TRUE(EngRanden::ForStream(master, long_key)() != first);
+}
+
+// ForStreams equals ForStream for each key, also for keys of multiple blocks
+// and an odd count.
+template <class Engine>
+void VerifyForStreams() {
+  std::seed_seq seq{7, 8, 9};
+  const Engine parent(seq);
+  const uint64_t ids[5] = {0, 1, 2, 1ull << 40, 4};
+  Engine streams[5];
+  Engine::ForStreams(parent, ids, 5, streams);
+  for (size_t i = 0; i < 5; ++i) {
+    ASSERT_TRUE(streams[i] == Engine::ForStream(parent, ids[i]));
+  }
+
+  const std::string names[3] = {"a", std::string(300, 'b'), "c"};
+  Engine::ForStreams(parent, names, 3, streams);
+  for (size_t i = 0; i < 3; ++i) {
+    ASSERT_TRUE(streams[i] == Engine::ForStream(parent, names[i]));
+  }
+}
+
+// Spans a refill (30 outputs per buffer).
+template <int kRounds>
+void VerifySimGolden(const uint64_t (&golden)[31]) {
+  RandenSim<uint64_t, kRounds> engine;
+#if UPDATE_GOLDEN
+  for (size_t i = 0; i < 31; ++i) {
+    printf("0x%016lx,\n", engine());
+  }
+  printf("\n");
+#else
+  for (size_t i = 0; i < 31; ++i) {
+    ASSERT_TRUE(golden[i] == engine());
+  }
+#endif
+}
+
+void VerifySimGoldens() {
+  const uint64_t golden5[31] = {
+      0x6b13cc2f2fba6c18, 0xa99d1293bf975b2b, 0x0dd9790e5d2cd6da,
+      0x678f8a96cf4562b3, 0xbf9c4eb40f9f8d88, 0xa270392f9607368d,
+      0x73fe0fc4e752f29d, 0x766cf1b0bee2a1f0, 0x5e50c94a0792045c,
+      0xb862446b315e34ae, 0xc3be5066263ec616, 0x571d4838181e23a3,
+      0xb2e51485c5ec97e9, 0x372f2e8c8e73d611, 0xd7b766b2de4f3165,
+      0x0639c047848bc35e, 0x927db207efa7f94f, 0x8f6915744a552147,
+      0x71cf1fbd40fa7579, 0x6270c0365d5d0074, 0xc4017083092ce3b6,
+      0x234bea7d3bb629df, 0x09e6785655328586, 0x085c317c71cdd56e,
+      0x74420f5707714405, 0x7693bbb6652d054e, 0x550cc1ba946e8528,
+      0xcced9e0aaad051ec, 0x5f55fa305a59a5d9, 0x84f4a8a62238b466,
+      0x52d76d75dddb6521};
+  VerifySimGolden<5>(golden5);
+
+  const uint64_t golden8[31] = {
+      0x995b0a52154a518f, 0x9d5580949195041e, 0xa17110026e75e97f,
+      0xea3634528b7cd8b3, 0xe978cf270596e8fb, 0x73406786144de7d0,
+      0x44b23cfcf8bb3888, 0x4bf6048555540b48, 0x2dca1ad2be582a5e,
+      0x9e89fa7e286662b9, 0x17b4126bf3818878, 0x09cf07daeaca61da,
+      0xcbf11f192fef0680, 0x7cbb4284e29adb9d, 0x6f022ed7d3ddb0ae,
+      0x89e4230d933469a3, 0xcfd535ff22587191, 0x8ed2752b31ab3920,
+      0x03e9f7df5ff10209, 0xa35cdf4165941692, 0x473f5978fbd6d684,
+      0x5360c5d98ee618d1, 0x3e28325c59b9fe40, 0x62a5b7e276956eba,
+      0xd4f04053aea233cd, 0xf89178d357b7addb, 0x1100e23f52bb83f1,
+      0xa72d69ef3bcc8cbc, 0x63e6c989a3b80fd8, 0xfdf0b052dd2b962d,
+      0x9a2de46459a80077};
+  VerifySimGolden<8>(golden8);
+}
+
+// Flipping any input bit flips about half the bits of every output block
+// after 8 rounds, but not after fewer (see randen_sim.h).
+template <int kRounds>
+void MinMaxAvalanche(double* min_fraction, double* max_fraction) {
+  std::mt19937_64 rng(12345);
+  alignas(32) uint64_t state1[Internal::kStateBytes / sizeof(uint64_t)];
+  alignas(32) uint64_t state2[Internal::kStateBytes / sizeof(uint64_t)];
+  constexpr int kBlocks = Internal::kStateBytes / 16;
+  constexpr int kTrials = 1000;
+  double flipped[kBlocks] = {0.0};
+  for (int trial = 0; trial < kTrials; ++trial) {
+    for (uint64_t& lane : state1) {
+      lane = rng();
+    }
+    memcpy(state2, state1, sizeof(state1));
+    const size_t bit = rng() % (sizeof(state1) * 8);
+    state2[bit / 64] ^= 1ull << (bit % 64);
+    inl::Permute<kRounds>(state1);
+    inl::Permute<kRounds>(state2);
+    for (int block = 0; block < kBlocks; ++block) {
+      for (int lane = 2 * block; lane < 2 * block + 2; ++lane) {
+        flipped[block] += __builtin_popcountll(state1[lane] ^ state2[lane]);
+      }
+    }
+  }
+  *min_fraction = 1.0;
+  *max_fraction = 0.0;
+  for (double count : flipped) {
+    const double fraction = count / (kTrials * 128.0);
+    *min_fraction = std::min(*min_fraction, fraction);
+    *max_fraction = std::max(*max_fraction, fraction);
+  }
+}
+
+void VerifySimDiffusion() {
+  double min_fraction, max_fraction;
+  MinMaxAvalanche<8>(&min_fraction, &max_fraction);
+  ASSERT_TRUE(0.48 < min_fraction && max_fraction < 0.52);
+  MinMaxAvalanche<5>(&min_fraction, &max_fraction);
+  ASSERT_TRUE(min_fraction < 0.4);
+}
+
 #endif  // ENABLE_VERIFY
 
 void VerifyRandReqEngine() {
@@ -273,14 +524,83 @@ void VerifyStreamOperators() {
   }
 }
 
+#if RANDEN_STATS
+
+// Built as bin/randen_stats_test.
+void VerifyStats() {
+  const RandenStats before = GetRandenStats();
+  {
+    EngRanden engine;
+    for (int i = 0; i < 100; ++i) {  // 4 refills of 30 values
+      (void)engine();
+    }
+    engine.discard(50);  // skips the remaining 20 and refills
+    std::seed_seq seq{1, 2, 3};
+    engine.reseed(seq);
+    (void)engine();
+  }  // counts the last value
+
+  // Exited threads' counters are retained.
+  std::thread([]() {
+    EngRanden engine;
+    (void)engine();
+  }).join();
+
+  // Engines destroyed after the thread's counters are still counted. The
+  // holder is constructed before the counters, hence destroyed after them.
+  std::thread([]() {
+    struct Holder {
+      ~Holder() { reinterpret_cast<EngRanden*>(&storage)->~EngRanden(); }
+      std::aligned_storage<sizeof(EngRanden), alignof(EngRanden)>::type
+          storage;
+    };
+    thread_local Holder holder;
+    EngRanden* engine = new (&holder.storage) EngRanden;
+    (void)(*engine)();
+  }).join();
+
+  const RandenStats after = GetRandenStats();
+  ASSERT_TRUE(after.generate_calls - before.generate_calls == 8);
+  ASSERT_TRUE(after.bytes_served - before.bytes_served == 103 * 8);
+  ASSERT_TRUE(after.reseeds - before.reseeds == 1);
+  ASSERT_TRUE(after.discards - before.discards == 1);
+}
+
+// ForStreams counts the values served by the engines it replaces.
+void VerifyForStreamsStats() {
+  EngRanden streams[3];
+  for (EngRanden& stream : streams) {
+    (void)stream();
+  }
+  const RandenStats before = GetRandenStats();
+  const int keys[3] = {1, 2, 3};
+  EngRanden::ForStreams(EngRanden(), keys, 3, streams);
+  const RandenStats after = GetRandenStats();
+  ASSERT_TRUE(after.bytes_served - before.bytes_served == 3 * 8);
+}
+
+#endif  // RANDEN_STATS
+
 void Verify() {
 #if ENABLE_VERIFY
   VerifyReseedChangesAllValues();
+  VerifyFill();
   VerifyDiscard();
   VerifyGolden();
+  VerifyChained();
+  VerifySimGoldens();
+  VerifySimDiffusion();
+  VerifyForStream();
+  VerifyForStreams<EngRanden>();
+  VerifyForStreams<Randen<uint64_t, ChainedSponge<2>>>();
+  VerifyForStreams<RandenSim<uint64_t, 8>>();
   VerifyRandReqEngine();
   VerifyStreamOperators();
 #endif
+#if RANDEN_STATS
+  VerifyStats();
+  VerifyForStreamsStats();
+#endif
 }
 
 void DumpOutput() {
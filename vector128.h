@@ -17,12 +17,19 @@
 #define VECTOR128_H_
 
 #include <stdint.h>     // uint64_t
+#include <string.h>     // memcpy
 
 #if defined(__SSE2__) && defined(__AES__)
 
 #define RANDEN_AESNI 1
 #include <wmmintrin.h>
 
+// 256-bit AES (e.g. Ice Lake), only if enabled via compiler flags (-mvaes).
+#if defined(__VAES__) && defined(__AVX2__)
+#define RANDEN_VAES 1
+#include <immintrin.h>
+#endif
+
 #elif defined(__powerpc__) && defined(__VSX__)
 
 #define RANDEN_PPC 1
@@ -145,6 +152,55 @@ static RANDEN_INLINE void Store(const V v, uint64_t* RANDEN_RESTRICT lanes,
 #endif
 }
 
+// Non-temporal store: bypasses the cache if supported (otherwise same as
+// Store). Call StoreFence before other threads may access the destination.
+static RANDEN_INLINE void StreamStore(const V v,
+                                      uint64_t* RANDEN_RESTRICT lanes,
+                                      const int block) {
+#ifdef RANDEN_AESNI
+  uint64_t* RANDEN_RESTRICT to = lanes + block * kLanes;
+  _mm_stream_si128(reinterpret_cast<__m128i * RANDEN_RESTRICT>(to), v.raw());
+#else
+  Store(v, lanes, block);
+#endif
+}
+
+// Non-temporal store to 8-byte aligned lanes (MOVNTI), for destinations that
+// are not 16-byte aligned (otherwise prefer StreamStore). Same as an unaligned
+// store if unsupported.
+static RANDEN_INLINE void StreamStore64(const V v,
+                                        uint64_t* RANDEN_RESTRICT lanes,
+                                        const int block) {
+  uint64_t* RANDEN_RESTRICT to = lanes + block * kLanes;
+#if defined(RANDEN_AESNI) && defined(__x86_64__)
+  const __m128i raw = v.raw();
+  _mm_stream_si64(reinterpret_cast<long long*>(to), _mm_cvtsi128_si64(raw));
+  _mm_stream_si64(reinterpret_cast<long long*>(to + 1),
+                  _mm_cvtsi128_si64(_mm_unpackhi_epi64(raw, raw)));
+#else
+  memcpy(to, &v, sizeof(v));
+#endif
+}
+
+// Orders preceding StreamStore/StreamStore64 before subsequent stores.
+static RANDEN_INLINE void StoreFence() {
+#ifdef RANDEN_AESNI
+  _mm_sfence();
+#endif
+}
+
+// Requests the cache line containing the given block, so that a subsequent
+// Load is less likely to stall. Never faults.
+static RANDEN_INLINE void Prefetch(const uint64_t* RANDEN_RESTRICT lanes,
+                                   const int block) {
+#if defined(__clang__) || defined(__GNUC__)
+  __builtin_prefetch(lanes + block * kLanes);
+#elif defined(RANDEN_AESNI)
+  _mm_prefetch(reinterpret_cast<const char*>(lanes + block * kLanes),
+               _MM_HINT_T0);
+#endif
+}
+
 // One round of AES. "round_key" is a public constant for breaking the
 // symmetry of AES (ensures previously equal columns differ afterwards).
 static RANDEN_INLINE V AES(const V state, const V round_key) {